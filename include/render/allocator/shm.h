@@ -4,15 +4,21 @@
 #include <wlr/types/wlr_buffer.h>
 #include "render/allocator/allocator.h"
 
+struct wlr_shm_arena;
+
 struct wlr_shm_buffer {
 	struct wlr_buffer base;
-	struct wlr_shm_attributes shm;
+	struct wlr_shm_attributes shm; // fd is owned by the arena
+	struct wlr_shm_arena *arena;
 	void *data;
-	size_t size;
+	size_t size; // size of the range reserved in the arena
 };
 
 struct wlr_shm_allocator {
 	struct wlr_allocator base;
+
+	// Large shm files which buffers are sub-allocated from
+	struct wl_list arenas; // wlr_shm_arena.link
 };
 
 /**
@@ -76,6 +76,9 @@ struct wlr_gles2_renderer {
 
 	struct wlr_gles2_buffer *current_buffer;
 	uint32_t viewport_width, viewport_height;
+
+	// Vertex buffer used by render passes, created on first use
+	GLuint vbo;
 };
 
 struct wlr_gles2_buffer {
@@ -112,6 +115,17 @@ struct wlr_gles2_texture {
 	struct wlr_addon buffer_addon;
 };
 
+struct wlr_gles2_render_pass {
+	struct wlr_render_pass base;
+	struct wlr_gles2_renderer *renderer;
+	int width, height;
+
+	// Quads are pre-clipped and recorded into a single vertex buffer, then
+	// drawn on submit with one draw call per texture or uniform change
+	struct wl_array draws; // struct wlr_gles2_render_draw
+	struct wl_array verts; // struct wlr_gles2_render_vertex
+};
+
 
 bool is_gles2_pixel_format_supported(const struct wlr_gles2_renderer *renderer,
 	const struct wlr_gles2_pixel_format *format);
@@ -130,6 +144,9 @@ struct wlr_texture *gles2_texture_from_buffer(struct wlr_renderer *wlr_renderer,
 	struct wlr_buffer *buffer);
 void gles2_texture_destroy(struct wlr_gles2_texture *texture);
 
+struct wlr_gles2_render_pass *begin_gles2_buffer_pass(
+	struct wlr_gles2_renderer *renderer, struct wlr_buffer *buffer);
+
 void push_gles2_debug_(struct wlr_gles2_renderer *renderer,
 	const char *file, const char *func);
 #define push_gles2_debug(renderer) push_gles2_debug_(renderer, _WLR_FILENAME, __func__)
@@ -13,6 +13,9 @@ struct wlr_pixman_pixel_format {
 };
 
 struct wlr_pixman_buffer;
+struct wlr_pixman_worker_pool;
+
+typedef void (*pixman_worker_func_t)(void *data, size_t index);
 
 struct wlr_pixman_renderer {
 	struct wlr_renderer wlr_renderer;
@@ -24,6 +27,13 @@ struct wlr_pixman_renderer {
 	int32_t width, height;
 
 	struct wlr_drm_format_set drm_formats;
+
+	// If non-NULL, render passes are replayed in parallel on these workers
+	struct wlr_pixman_worker_pool *workers;
+
+	// If true, textures created from buffers keep a private copy of the
+	// pixels instead of locking the buffer
+	bool shadow_textures;
 };
 
 struct wlr_pixman_buffer {
@@ -45,13 +55,17 @@ struct wlr_pixman_texture {
 	pixman_format_code_t format;
 	const struct wlr_pixel_format_info *format_info;
 
-	void *data; // if created via texture_from_pixels
-	struct wlr_buffer *buffer; // if created via texture_from_buffer
+	void *data; // private copy of the pixels, if any
+	struct wlr_buffer *buffer; // locked source buffer, if any
 };
 
 struct wlr_pixman_render_pass {
 	struct wlr_render_pass base;
 	struct wlr_pixman_buffer *buffer;
+
+	// Operations recorded for tiled rendering on submit, only used if the
+	// renderer has workers
+	struct wl_array ops; // struct wlr_pixman_render_op
 };
 
 pixman_format_code_t get_pixman_format_from_drm(uint32_t fmt);
@@ -64,4 +78,17 @@ bool begin_pixman_data_ptr_access(struct wlr_buffer *buffer, pixman_image_t **im
 struct wlr_pixman_render_pass *begin_pixman_render_pass(
 	struct wlr_pixman_buffer *buffer);
 
+/**
+ * Create a pool of worker threads.
+ */
+struct wlr_pixman_worker_pool *pixman_worker_pool_create(size_t threads_len);
+void pixman_worker_pool_destroy(struct wlr_pixman_worker_pool *pool);
+size_t pixman_worker_pool_get_threads_len(struct wlr_pixman_worker_pool *pool);
+/**
+ * Call func for each index in [0, len) and wait for all calls to return.
+ * The calls are spread across the workers and the calling thread.
+ */
+void pixman_worker_pool_run(struct wlr_pixman_worker_pool *pool,
+	pixman_worker_func_t func, void *data, size_t len);
+
 #endif
@@ -0,0 +1,73 @@
+#ifndef RENDER_UPLOAD_WORKER_H
+#define RENDER_UPLOAD_WORKER_H
+
+#include <pixman.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <wayland-util.h>
+
+struct wlr_buffer;
+struct wlr_upload_worker;
+struct wlr_upload_job;
+
+/**
+ * A copy of the damaged rectangles of a buffer into staging memory, performed
+ * on a worker thread. Rectangles are written in region order, each one
+ * tightly packed (its stride is its width times bytes_per_pixel).
+ *
+ * The data pointer access to the buffer is begun on the main thread before
+ * the job is submitted, and only ended when the job is finished: this keeps
+ * the mapping and its SIGBUS handling alive while the worker reads it, and
+ * leaves all of the buffer's bookkeeping to the main thread. The buffer is
+ * locked until the job is finished, and must not be accessed in the meantime:
+ * the renderer owning the job finishes it first.
+ */
+struct wlr_upload_job {
+	struct wlr_buffer *buffer;
+	const void *data;
+	size_t stride;
+	pixman_region32_t region;
+	size_t bytes_per_pixel;
+	void *dst;
+
+	// private state
+
+	bool done;
+	struct wl_list link; // wlr_upload_worker.queue
+};
+
+/**
+ * Create a worker thread, if asynchronous uploads are enabled via the
+ * WLR_RENDER_ASYNC_UPLOAD environment variable. Returns NULL otherwise.
+ */
+struct wlr_upload_worker *upload_worker_create(void);
+void upload_worker_destroy(struct wlr_upload_worker *worker);
+
+/**
+ * Size in bytes of the staging memory needed to upload a region.
+ */
+size_t upload_region_size(const pixman_region32_t *region,
+	size_t bytes_per_pixel);
+
+/**
+ * Queue a copy of the region of the buffer into dst. The caller must have
+ * begun a data pointer access to the buffer, which returned data and stride:
+ * on success, the job takes over the access. dst must be at least
+ * upload_region_size() bytes long, and stay valid until the job is finished.
+ */
+struct wlr_upload_job *upload_worker_submit(struct wlr_upload_worker *worker,
+	struct wlr_buffer *buffer, const void *data, size_t stride,
+	const pixman_region32_t *region, size_t bytes_per_pixel, void *dst);
+/**
+ * Wait for the job to complete.
+ */
+void upload_job_wait(struct wlr_upload_worker *worker,
+	struct wlr_upload_job *job);
+/**
+ * Wait for the job to complete, then end the data pointer access to the
+ * buffer, release it and free the job.
+ */
+void upload_job_finish(struct wlr_upload_worker *worker,
+	struct wlr_upload_job *job);
+
+#endif
@@ -217,6 +217,10 @@ struct wlr_vk_renderer {
 	size_t last_output_pool_size;
 	struct wl_list output_descriptor_pools; // wlr_vk_descriptor_pool.link
 
+	// Holds a single unit clip rectangle, bound for draws without clipping
+	VkBuffer unit_rect_buffer;
+	VkDeviceMemory unit_rect_memory;
+
 	VkSemaphore timeline_semaphore;
 	uint64_t timeline_point;
 
@@ -251,6 +255,13 @@ struct wlr_vk_renderer {
 		struct wl_list buffers; // wlr_vk_shared_buffer.link
 	} stage;
 
+	// If non-NULL, shm texture updates are copied into stage buffers on
+	// this worker thread. Pending copies are waited for at the end of the
+	// event loop iteration, or before the stage command buffer is submitted.
+	struct wlr_upload_worker *upload_worker;
+	struct wl_array pending_uploads; // struct wlr_upload_job *
+	struct wl_event_source *uploads_idle;
+
 	struct {
 		bool initialized;
 		uint32_t drm_format;
@@ -263,10 +274,36 @@ struct wlr_vk_renderer {
 // Creates a vulkan renderer for the given device.
 struct wlr_renderer *vulkan_renderer_create_for_device(struct wlr_vk_device *dev);
 
+// vertex shader push constant range data
+struct wlr_vk_vert_pcr_data {
+	float mat4[4][4];
+	float uv_off[2];
+	float uv_size[2];
+};
+
+// Converts a color channel from sRGB to linear.
+float vulkan_color_to_linear(float non_linear);
+void vulkan_mat3_to_mat4(const float mat3[9], float mat4[4][4]);
+
+struct wlr_vk_render_pass {
+	struct wlr_render_pass base;
+	struct wlr_vk_renderer *renderer;
+	int width, height;
+
+	struct wl_array ops; // struct wlr_vk_render_op
+	// Clip rectangles drawn as instances, referenced by ops
+	struct wl_array rects; // float[4]
+};
+
+struct wlr_vk_render_pass *vulkan_begin_render_pass(
+	struct wlr_vk_renderer *renderer, struct wlr_buffer *buffer);
+
 // stage utility - for uploading/retrieving data
 // Gets an command buffer in recording state which is guaranteed to be
 // executed before the next frame.
 VkCommandBuffer vulkan_record_stage_cb(struct wlr_vk_renderer *renderer);
+// Wait for the upload worker to fill in the stage buffers
+void vulkan_finish_uploads(struct wlr_vk_renderer *renderer);
 
 // Submits the current stage command buffer and waits until it has
 // finished execution.
@@ -331,6 +368,10 @@ struct wlr_vk_texture {
 };
 
 struct wlr_vk_texture *vulkan_get_texture(struct wlr_texture *wlr_texture);
+// Marks the texture as used by the current render command buffer.
+void vulkan_use_texture(struct wlr_vk_texture *texture);
+VkPipeline vulkan_get_texture_pipeline(struct wlr_vk_texture *texture,
+	struct wlr_vk_render_format_setup *render_setup);
 VkImage vulkan_import_dmabuf(struct wlr_vk_renderer *renderer,
 	const struct wlr_dmabuf_attributes *attribs,
 	VkDeviceMemory mems[static WLR_DMABUF_MAX_PLANES], uint32_t *n_mems,
@@ -357,6 +398,7 @@ struct wlr_vk_shared_buffer {
 	VkBuffer buffer;
 	VkDeviceMemory memory;
 	VkDeviceSize buf_size;
+	void *cpu_mapping; // persistently mapped
 	struct wl_array allocs; // struct wlr_vk_allocation
 };
 
@@ -27,5 +27,11 @@ const struct wlr_drm_format_set *wlr_renderer_get_render_formats(
  * This functions returns a bitfield of supported wlr_buffer_cap.
  */
 uint32_t renderer_get_render_buffer_caps(struct wlr_renderer *renderer);
+/**
+ * Set the event loop of the display whose client buffers are imported by the
+ * renderer. The renderer may defer work to it.
+ */
+void renderer_set_event_loop(struct wlr_renderer *renderer,
+	struct wl_event_loop *loop);
 
 #endif
@@ -59,4 +59,38 @@ bool dmabuf_buffer_drop(struct wlr_dmabuf_buffer *buffer);
  */
 bool buffer_is_opaque(struct wlr_buffer *buffer);
 
+/**
+ * Check whether a buffer is filled with a single color, without uploading it
+ * to the GPU. This is the case for single-pixel buffers and for 1x1 buffers
+ * whose pixel can be read from the CPU.
+ *
+ * On success, the pre-multiplied color is written to the color argument.
+ */
+bool buffer_get_solid_color(struct wlr_buffer *buffer, float color[static 4]);
+
+/**
+ * Update a buffer-local region of fully opaque pixels by scanning the damaged
+ * area of the buffer. Pixels outside of the damage are assumed to be
+ * unchanged. Runs of opaque pixels shorter than a few pixels are skipped.
+ *
+ * Returns false if the buffer's pixels can't be read from the CPU right now
+ * or if its format doesn't have an 8-bit alpha channel, in which case the
+ * region is left untouched.
+ */
+bool buffer_update_opaque_region(struct wlr_buffer *buffer,
+	pixman_region32_t *opaque, const pixman_region32_t *damage);
+
+/**
+ * Estimated size of the texture of a client buffer, in bytes.
+ */
+size_t client_buffer_texture_size(struct wlr_client_buffer *buffer);
+/**
+ * Stop tracking a client buffer in its texture cache, if any.
+ */
+void texture_cache_remove_buffer(struct wlr_client_buffer *buffer);
+/**
+ * Account for a client buffer whose evicted texture has been uploaded again.
+ */
+void texture_cache_handle_restore(struct wlr_client_buffer *buffer);
+
 #endif
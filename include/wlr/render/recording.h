@@ -0,0 +1,101 @@
+/*
+ * This an unstable interface of wlroots. No guarantees are made regarding the
+ * future consistency of this API.
+ */
+#ifndef WLR_USE_UNSTABLE
+#error "Add -DWLR_USE_UNSTABLE to enable unstable wlroots features"
+#endif
+
+#ifndef WLR_RENDER_RECORDING_H
+#define WLR_RENDER_RECORDING_H
+
+#include <pixman.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <wayland-server-core.h>
+#include <wayland-server-protocol.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/util/box.h>
+
+enum wlr_render_recording_op_type {
+	WLR_RENDER_RECORDING_OP_TEXTURE,
+	WLR_RENDER_RECORDING_OP_RECT,
+};
+
+/**
+ * A recorded render pass operation. Default values of the original options
+ * are resolved: boxes are never empty and the clip region is always set.
+ */
+struct wlr_render_recording_op {
+	enum wlr_render_recording_op_type type;
+
+	struct {
+		// The texture isn't referenced by the recording, this pointer is
+		// dangling once the texture is destroyed
+		struct wlr_texture *texture;
+		uint32_t width, height; // texture size
+		struct wlr_fbox src_box;
+		struct wlr_box dst_box;
+		float alpha;
+		enum wl_output_transform transform;
+	} texture;
+
+	struct {
+		struct wlr_box box;
+		struct wlr_render_color color;
+		enum wlr_render_blend_mode blend_mode;
+	} rect;
+
+	// Buffer-local clip region
+	pixman_region32_t clip;
+};
+
+/**
+ * A display list capturing the operations submitted to a render pass.
+ *
+ * The recording can be inspected, written out in a line-based text format
+ * suitable for diffing, or replayed against any other render pass.
+ */
+struct wlr_render_recording {
+	int width, height; // size of the recorded render buffer
+	struct wl_array ops; // struct wlr_render_recording_op
+
+	struct {
+		struct wl_signal destroy;
+	} events;
+};
+
+struct wlr_render_recording *wlr_render_recording_create(void);
+void wlr_render_recording_destroy(struct wlr_render_recording *recording);
+/**
+ * Remove all recorded operations.
+ */
+void wlr_render_recording_reset(struct wlr_render_recording *recording);
+/**
+ * Begin recording a render pass targeting a buffer of the given size. All
+ * previously recorded operations are removed.
+ *
+ * If target is not NULL, all operations are forwarded to it, and submitting
+ * the returned render pass submits the target. Otherwise, operations are only
+ * recorded.
+ */
+struct wlr_render_pass *wlr_render_recording_begin_pass(
+	struct wlr_render_recording *recording, struct wlr_render_pass *target,
+	int width, int height);
+/**
+ * Replay the recorded operations onto a render pass.
+ *
+ * All recorded textures must still be alive and belong to the render pass'
+ * renderer. To replay onto another renderer, replace the texture pointers in
+ * the recorded operations first.
+ */
+void wlr_render_recording_replay(struct wlr_render_recording *recording,
+	struct wlr_render_pass *render_pass);
+/**
+ * Write the recorded operations in a line-based text format. Textures are
+ * identified by their order of first use in the recording.
+ */
+bool wlr_render_recording_write(struct wlr_render_recording *recording,
+	FILE *f);
+
+#endif
@@ -2,6 +2,8 @@
 #define WLR_RENDER_SWAPCHAIN_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <wayland-server-core.h>
 #include <wlr/render/drm_format_set.h>
 
@@ -22,6 +24,13 @@ struct wlr_swapchain {
 	struct wlr_drm_format format;
 
 	struct wlr_swapchain_slot slots[WLR_SWAPCHAIN_CAP];
+	size_t len; // number of usable slots, at most WLR_SWAPCHAIN_CAP
+
+	struct {
+		uint64_t acquired; // successful acquisitions
+		uint64_t allocated; // buffers allocated
+		uint64_t starved; // acquisitions which failed because all slots were busy
+	} stats;
 
 	struct wl_listener allocator_destroy;
 };
@@ -29,15 +38,35 @@ struct wlr_swapchain {
 struct wlr_swapchain *wlr_swapchain_create(
 	struct wlr_allocator *alloc, int width, int height,
 	const struct wlr_drm_format *format);
+/**
+ * Create a swap chain with at most len buffers. A length of 2 minimizes
+ * latency, 3 or more allows rendering ahead of the display under GPU load.
+ * len must be between 1 and WLR_SWAPCHAIN_CAP.
+ *
+ * wlr_swapchain_create() uses a length of WLR_SWAPCHAIN_CAP.
+ */
+struct wlr_swapchain *wlr_swapchain_create_with_len(
+	struct wlr_allocator *alloc, int width, int height,
+	const struct wlr_drm_format *format, size_t len);
 void wlr_swapchain_destroy(struct wlr_swapchain *swapchain);
 /**
  * Acquire a buffer from the swap chain.
  *
+ * Released buffers are re-used before new ones are allocated, preferring the
+ * buffer with the smallest age.
+ *
  * The returned buffer is locked. When the caller is done with it, they must
  * unlock it by calling wlr_buffer_unlock.
  */
 struct wlr_buffer *wlr_swapchain_acquire(struct wlr_swapchain *swapchain,
 	int *age);
+/**
+ * Allocate buffers for all empty slots, so that later calls to
+ * wlr_swapchain_acquire() don't need to allocate.
+ *
+ * Returns false if a buffer couldn't be allocated.
+ */
+bool wlr_swapchain_prealloc(struct wlr_swapchain *swapchain);
 /**
  * Mark the buffer as submitted for presentation. This needs to be called by
  * swap chain users on frame boundaries.
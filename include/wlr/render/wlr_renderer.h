@@ -41,6 +41,10 @@ struct wlr_renderer {
 
 	bool rendering;
 	bool rendering_with_buffer;
+
+	// Event loop work can be deferred to, if any
+	struct wl_event_loop *event_loop;
+	struct wl_listener event_loop_destroy;
 };
 
 /**
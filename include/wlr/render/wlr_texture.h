@@ -52,6 +52,15 @@ struct wlr_texture *wlr_texture_from_dmabuf(struct wlr_renderer *renderer,
 bool wlr_texture_update_from_buffer(struct wlr_texture *texture,
 	struct wlr_buffer *buffer, const pixman_region32_t *damage);
 
+/**
+ * Read back the whole contents of a texture. `stride` is in bytes.
+ *
+ * Returns false if the renderer can't read back this texture, e.g. because it
+ * has been imported from a DMA-BUF, or if the format isn't supported.
+ */
+bool wlr_texture_read_pixels(struct wlr_texture *texture, uint32_t fmt,
+	uint32_t stride, void *data);
+
 /**
  * Destroys the texture.
  */
@@ -16,6 +16,7 @@
 
 struct wlr_buffer;
 struct wlr_renderer;
+struct wlr_texture_cache;
 
 struct wlr_shm_attributes {
 	int fd;
@@ -140,7 +141,10 @@ struct wlr_client_buffer {
 
 	/**
 	 * The buffer's texture, if any. A buffer will not have a texture if the
-	 * client destroys the buffer before it has been released.
+	 * client destroys the buffer before it has been released, if the texture
+	 * has been evicted by a struct wlr_texture_cache, or if the buffer is
+	 * filled with a single color. Use wlr_client_buffer_get_texture() to
+	 * restore evicted textures and create single-color ones.
 	 */
 	struct wlr_texture *texture;
 	/**
@@ -153,6 +157,22 @@ struct wlr_client_buffer {
 	struct wl_listener source_destroy;
 
 	size_t n_ignore_locks;
+
+	// Set if the buffer is filled with a single color, e.g. a single-pixel
+	// buffer. The color is pre-multiplied.
+	bool solid;
+	float solid_color[4];
+
+	struct wlr_renderer *renderer;
+	struct wlr_texture_cache *texture_cache; // may be NULL
+	struct wl_list texture_cache_link; // wlr_texture_cache.buffers
+	uint64_t texture_cache_frame; // last frame the buffer was visible
+	size_t texture_cache_displayed; // number of users displaying the buffer
+	// DRM format of the texture, DRM_FORMAT_INVALID if the texture can't be
+	// read back from system memory
+	uint32_t format;
+	// Contents of the evicted texture, in the format above
+	void *evicted_data;
 };
 
 /**
@@ -167,6 +187,12 @@ struct wlr_client_buffer *wlr_client_buffer_create(struct wlr_buffer *buffer,
  * buffer, returns NULL.
  */
 struct wlr_client_buffer *wlr_client_buffer_get(struct wlr_buffer *buffer);
+/**
+ * Get the texture of a client buffer, uploading it again if it has been
+ * evicted by a struct wlr_texture_cache. Returns NULL on error.
+ */
+struct wlr_texture *wlr_client_buffer_get_texture(
+	struct wlr_client_buffer *buffer);
 /**
  * Check if a resource is a wl_buffer resource.
  */
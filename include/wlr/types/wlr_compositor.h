@@ -165,6 +165,11 @@ struct wlr_surface {
 	bool opaque;
 	bool has_buffer;
 
+	// Buffer-local region of fully opaque pixels found by scanning the
+	// buffer, only maintained if scan_opaque is set
+	pixman_region32_t opaque_pixels;
+	bool scan_opaque;
+
 	int32_t preferred_buffer_scale;
 	bool preferred_buffer_transform_sent;
 	enum wl_output_transform preferred_buffer_transform;
@@ -182,6 +187,10 @@ struct wlr_compositor {
 		struct wl_signal new_surface;
 		struct wl_signal destroy;
 	} events;
+
+	// private state
+
+	bool scan_opaque;
 };
 
 typedef void (*wlr_surface_iterator_func_t)(struct wlr_surface *surface,
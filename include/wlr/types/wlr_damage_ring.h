@@ -17,6 +17,9 @@
 /* For triple buffering, a history of two frames is required. */
 #define WLR_DAMAGE_RING_PREVIOUS_LEN 2
 
+/* Default rectangle budget for accumulated buffer damage. */
+#define WLR_DAMAGE_RING_DEFAULT_MAX_RECTS 20
+
 struct wlr_box;
 
 struct wlr_damage_ring {
@@ -25,6 +28,11 @@ struct wlr_damage_ring {
 	// Difference between the current buffer and the previous one
 	pixman_region32_t current;
 
+	// Maximum number of rectangles in the accumulated buffer damage. Above
+	// this, rectangles are merged, trading some extra repainted area for
+	// fewer draw calls. Zero disables simplification.
+	size_t max_rects;
+
 	// private state
 
 	pixman_region32_t previous[WLR_DAMAGE_RING_PREVIOUS_LEN];
@@ -182,6 +182,7 @@ struct wlr_output {
 
 	struct wl_event_source *idle_frame;
 	struct wl_event_source *idle_done;
+	struct wl_event_source *idle_swapchain_prealloc;
 
 	int attach_render_locks; // number of locks forcing rendering
 
@@ -197,6 +198,10 @@ struct wlr_output {
 	struct wlr_renderer *renderer;
 	struct wlr_swapchain *swapchain;
 	struct wlr_buffer *back_buffer;
+	// If true, all buffers of the primary swapchain are allocated and
+	// imported into the renderer shortly after the swapchain is configured
+	// (e.g. on mode set), instead of lazily while rendering the first frames
+	bool swapchain_prealloc;
 
 	struct wl_listener display_destroy;
 
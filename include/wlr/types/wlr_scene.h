@@ -28,6 +28,7 @@
 #include <wlr/util/box.h>
 
 struct wlr_output;
+struct wlr_render_recording;
 struct wlr_output_layout;
 struct wlr_xdg_surface;
 struct wlr_layer_surface_v1;
@@ -39,6 +40,7 @@ struct wlr_scene_buffer;
 
 struct wlr_presentation;
 struct wlr_linux_dmabuf_v1;
+struct wlr_texture_cache;
 
 typedef bool (*wlr_scene_buffer_point_accepts_input_func_t)(
 	struct wlr_scene_buffer *buffer, int sx, int sy);
@@ -86,6 +88,12 @@ struct wlr_scene_tree {
 	struct wlr_scene_node node;
 
 	struct wl_list children; // wlr_scene_node.link
+
+	// private state
+
+	// Bounding box of all enabled descendants, relative to the tree
+	struct wlr_box bounds;
+	bool bounds_dirty;
 };
 
 /** The root scene-graph node. */
@@ -97,15 +105,21 @@ struct wlr_scene {
 	// May be NULL
 	struct wlr_presentation *presentation;
 	struct wlr_linux_dmabuf_v1 *linux_dmabuf_v1;
+	struct wlr_texture_cache *texture_cache;
 
 	// private state
 
 	struct wl_listener presentation_destroy;
 	struct wl_listener linux_dmabuf_v1_destroy;
+	struct wl_listener texture_cache_destroy;
+	uint64_t texture_cache_frame;
 
 	enum wlr_scene_debug_damage_option debug_damage_option;
 	bool direct_scanout;
 	bool calculate_visibility;
+
+	int transaction_depth;
+	pixman_region32_t transaction_update_region;
 };
 
 /** A scene-graph node displaying a single surface. */
@@ -173,6 +187,57 @@ struct wlr_scene_buffer {
 	enum wl_output_transform transform;
 	pixman_region32_t opaque_region;
 	struct wlr_linux_dmabuf_feedback_v1_init_options prev_feedback_options;
+
+	// Set if the buffer is filled with a single color. Such buffers are
+	// drawn as rectangles instead of being uploaded and sampled.
+	bool solid;
+	float solid_color[4];
+
+	// Set if the buffer is marked as displayed in the scene's texture cache
+	bool texture_cache_displayed;
+};
+
+/** Outcome of the direct scan-out attempt for a frame */
+enum wlr_scene_direct_scanout_result {
+	WLR_SCENE_DIRECT_SCANOUT_SUCCESS,
+	// Disabled via WLR_SCENE_DISABLE_DIRECT_SCANOUT
+	WLR_SCENE_DIRECT_SCANOUT_DISABLED,
+	// Damage highlighting is enabled
+	WLR_SCENE_DIRECT_SCANOUT_DEBUG_DAMAGE,
+	// The render list doesn't contain exactly one node
+	WLR_SCENE_DIRECT_SCANOUT_NODE_COUNT,
+	// The single node isn't a buffer
+	WLR_SCENE_DIRECT_SCANOUT_NOT_BUFFER,
+	// The output doesn't allow direct scan-out, e.g. software cursors
+	WLR_SCENE_DIRECT_SCANOUT_OUTPUT_DISALLOWED,
+	// The buffer is cropped
+	WLR_SCENE_DIRECT_SCANOUT_SRC_BOX,
+	// The buffer transform doesn't match the output transform
+	WLR_SCENE_DIRECT_SCANOUT_TRANSFORM,
+	// The buffer doesn't exactly cover the output
+	WLR_SCENE_DIRECT_SCANOUT_GEOMETRY,
+	// The backend rejected the buffer
+	WLR_SCENE_DIRECT_SCANOUT_TEST_FAILED,
+	// The output commit failed
+	WLR_SCENE_DIRECT_SCANOUT_COMMIT_FAILED,
+};
+
+/**
+ * Statistics about the last frame committed by wlr_scene_output_commit().
+ * Areas are in output buffer pixels.
+ */
+struct wlr_scene_output_frame_stats {
+	// Number of nodes in the render list
+	size_t render_list_len;
+	// Number of render pass operations submitted, including the background
+	size_t ops_len;
+	// Sum of the areas drawn by all operations, including the background
+	uint64_t pixels_written;
+	// Area removed from the operations by opaque regions of the nodes above
+	uint64_t pixels_culled;
+	// Area repainted in this frame, and total area of the output
+	uint64_t damage_area, output_area;
+	enum wlr_scene_direct_scanout_result direct_scanout;
 };
 
 /** A viewport for an output in the scene-graph */
@@ -186,6 +251,9 @@ struct wlr_scene_output {
 
 	int x, y;
 
+	// Updated on each wlr_scene_output_commit() call which presents a frame
+	struct wlr_scene_output_frame_stats frame_stats;
+
 	struct {
 		struct wl_signal destroy;
 	} events;
@@ -201,7 +269,15 @@ struct wlr_scene_output {
 
 	struct wl_list damage_highlight_regions;
 
+	// Cached between frames, rebuilt when the scene structure changes
 	struct wl_array render_list;
+	bool render_list_dirty;
+
+	// Last texture cache frame this output rendered in
+	uint64_t texture_cache_frame;
+
+	struct wlr_render_recording *recording;
+	struct wl_listener recording_destroy;
 };
 
 /** A layer shell scene helper */
@@ -282,6 +358,23 @@ struct wlr_scene_node *wlr_scene_node_at(struct wlr_scene_node *node,
  */
 struct wlr_scene *wlr_scene_create(void);
 
+/**
+ * Start batching changes to the scene-graph.
+ *
+ * Until the matching wlr_scene_commit_transaction() call, changes to nodes
+ * only record the area they affect. Visibility and output damage for all of
+ * them are computed at once when the transaction is committed. Transactions
+ * can be nested, in which case only the outermost commit applies the changes.
+ *
+ * The scene must not be rendered while a transaction is in progress.
+ */
+void wlr_scene_begin_transaction(struct wlr_scene *scene);
+/**
+ * Apply all changes made since the matching wlr_scene_begin_transaction()
+ * call.
+ */
+void wlr_scene_commit_transaction(struct wlr_scene *scene);
+
 /**
  * Handle presentation feedback for all surfaces in the scene, assuming that
  * scene outputs and the scene rendering functions are used.
@@ -299,6 +392,18 @@ void wlr_scene_set_presentation(struct wlr_scene *scene,
 void wlr_scene_set_linux_dmabuf_v1(struct wlr_scene *scene,
 	struct wlr_linux_dmabuf_v1 *linux_dmabuf_v1);
 
+/**
+ * Track the textures of the client buffers displayed in the scene with a
+ * texture cache. Buffers visible on any output are never evicted, and the
+ * cache frame ends once per round of output frames, evicting idle textures
+ * when the cache is over budget.
+ *
+ * Asserts that a struct wlr_texture_cache hasn't already been set for the
+ * scene.
+ */
+void wlr_scene_set_texture_cache(struct wlr_scene *scene,
+	struct wlr_texture_cache *cache);
+
 
 /**
  * Add a node displaying nothing but its children.
@@ -425,6 +530,20 @@ void wlr_scene_output_set_position(struct wlr_scene_output *scene_output,
  * Render and commit an output.
  */
 bool wlr_scene_output_commit(struct wlr_scene_output *scene_output);
+/**
+ * Record the render pass operations of each frame rendered by
+ * wlr_scene_output_commit() into the recording, replacing the previous
+ * frame's operations. Frames presented via direct scan-out are not recorded.
+ *
+ * Pass NULL to stop recording.
+ */
+void wlr_scene_output_set_recording(struct wlr_scene_output *scene_output,
+	struct wlr_render_recording *recording);
+/**
+ * Get a human-readable description of a direct scan-out result.
+ */
+const char *wlr_scene_direct_scanout_result_str(
+	enum wlr_scene_direct_scanout_result result);
 /**
  * Call wlr_surface_send_frame_done() on all surfaces in the scene rendered by
  * wlr_scene_output_commit() for which wlr_scene_surface.primary_output
@@ -10,10 +10,33 @@
 #define WLR_TYPES_WLR_SINGLE_PIXEL_BUFFER_V1_H
 
 #include <wayland-server-core.h>
+#include <wlr/types/wlr_buffer.h>
 
 struct wlr_single_pixel_buffer_manager_v1;
 
+/**
+ * A buffer containing a single pixel, created by a client via the
+ * single-pixel-buffer-v1 protocol.
+ */
+struct wlr_single_pixel_buffer_v1 {
+	struct wlr_buffer base;
+	struct wl_resource *resource;
+	// Pre-multiplied color channels, between 0 and UINT32_MAX
+	uint32_t r, g, b, a;
+
+	// private state
+
+	uint8_t argb8888[4]; // packed little-endian DRM_FORMAT_ARGB8888
+};
+
 struct wlr_single_pixel_buffer_manager_v1 *wlr_single_pixel_buffer_manager_v1_create(
 	struct wl_display *display);
 
+/**
+ * Get a single-pixel buffer from a generic buffer. Returns NULL if the buffer
+ * wasn't created via the single-pixel-buffer-v1 protocol.
+ */
+struct wlr_single_pixel_buffer_v1 *wlr_single_pixel_buffer_v1_try_from_buffer(
+	struct wlr_buffer *buffer);
+
 #endif
@@ -0,0 +1,95 @@
+/*
+ * This an unstable interface of wlroots. No guarantees are made regarding the
+ * future consistency of this API.
+ */
+#ifndef WLR_USE_UNSTABLE
+#error "Add -DWLR_USE_UNSTABLE to enable unstable wlroots features"
+#endif
+
+#ifndef WLR_TYPES_WLR_TEXTURE_CACHE_H
+#define WLR_TYPES_WLR_TEXTURE_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wayland-server-core.h>
+
+struct wlr_client_buffer;
+struct wlr_texture;
+
+/**
+ * Bounds the memory used by the textures of client buffers.
+ *
+ * Client buffers are added to the cache by their user (e.g. the scene-graph,
+ * see wlr_scene_set_texture_cache()), which reports which ones are displayed
+ * and when a frame ends. When the resident textures exceed the budget, the
+ * textures of the buffers which haven't been visible for the longest time are
+ * read back to system memory and destroyed. They are uploaded again the next
+ * time they're needed, see wlr_client_buffer_get_texture().
+ *
+ * Textures imported from a DMA-BUF and textures which the renderer can't read
+ * back are never evicted.
+ */
+struct wlr_texture_cache {
+	// Size of the resident textures above which textures are evicted, in
+	// bytes. Sizes are estimated with 4 bytes per pixel.
+	size_t budget;
+	// Minimum number of frames a buffer must have been invisible before its
+	// texture can be evicted
+	uint64_t min_idle_frames;
+
+	struct {
+		size_t resident_textures, resident_bytes;
+		size_t evicted_textures, evicted_bytes;
+		// Totals since the cache has been created
+		uint64_t evictions, restores;
+	} stats;
+
+	struct {
+		struct wl_signal destroy;
+	} events;
+
+	// private state
+
+	struct wl_list buffers; // wlr_client_buffer.texture_cache_link
+	uint64_t frame;
+};
+
+/**
+ * Create a texture cache with the given budget, in bytes.
+ */
+struct wlr_texture_cache *wlr_texture_cache_create(size_t budget);
+/**
+ * Destroy the cache. Buffers whose texture has been evicted keep a copy of
+ * their contents and can still be restored.
+ */
+void wlr_texture_cache_destroy(struct wlr_texture_cache *cache);
+/**
+ * Start tracking the texture of a client buffer. A buffer can only be part of
+ * a single cache. Adding a buffer marks it as visible. Buffers backed by a
+ * DMA-BUF are ignored.
+ */
+void wlr_texture_cache_add(struct wlr_texture_cache *cache,
+	struct wlr_client_buffer *buffer);
+/**
+ * Mark a client buffer as visible in the current frame. Buffers which aren't
+ * part of the cache are ignored.
+ */
+void wlr_texture_cache_mark_visible(struct wlr_texture_cache *cache,
+	struct wlr_client_buffer *buffer);
+/**
+ * Mark a client buffer as displayed, or not displayed anymore, by one of its
+ * users. Displayed buffers are never evicted. Once no user displays a buffer
+ * anymore, it's considered visible until the current frame. Buffers which
+ * aren't part of the cache are ignored.
+ */
+void wlr_texture_cache_set_displayed(struct wlr_texture_cache *cache,
+	struct wlr_client_buffer *buffer, bool displayed);
+/**
+ * End the current frame, and evict the textures of idle buffers while the
+ * budget is exceeded. Only a few textures are evicted per frame, to bound the
+ * time spent reading them back.
+ */
+void wlr_texture_cache_end_frame(struct wlr_texture_cache *cache);
+
+#endif
@@ -45,6 +45,13 @@ void wlr_region_transform(pixman_region32_t *dst, const pixman_region32_t *src,
 void wlr_region_expand(pixman_region32_t *dst, const pixman_region32_t *src,
 	int distance);
 
+/**
+ * Expands the region by distance_x horizontally and distance_y vertically.
+ * Both distances must be non-negative numbers.
+ */
+void wlr_region_expand_xy(pixman_region32_t *dst, const pixman_region32_t *src,
+	int distance_x, int distance_y);
+
 /*
  * Builds the smallest possible region that contains the region rotated about
  * the point (ox, oy).
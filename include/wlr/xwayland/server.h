@@ -10,6 +10,7 @@
 #define WLR_XWAYLAND_SERVER_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <sys/types.h>
 #include <time.h>
 #include <wayland-server-core.h>
@@ -20,6 +21,19 @@ struct wlr_xwayland_server_options {
 	bool no_touch_pointer_emulation;
 	bool force_xrandr_emulation;
 	int terminate_delay; // in seconds, 0 to terminate immediately
+	/**
+	 * In lazy mode, keep a spare Xwayland ready instead of waiting for a
+	 * client to connect: one is started right away, and again each time
+	 * the previous one exits.
+	 */
+	bool prewarm;
+	/**
+	 * Time after which a spare Xwayland which hasn't been used is stopped,
+	 * after which Xwayland is started lazily again. In seconds, 0 to keep
+	 * the spare forever. The spare is considered used once its XWM sees a
+	 * client window, so this requires enable_wm.
+	 */
+	int prewarm_idle_timeout;
 };
 
 struct wlr_xwayland_server {
@@ -29,6 +43,10 @@ struct wlr_xwayland_server {
 	int wm_fd[2], wl_fd[2];
 
 	time_t server_start;
+	int64_t start_msec;
+
+	// Whether Xwayland was started ahead of time and has no client yet
+	bool spare;
 
 	/* Anything above display is reset on Xwayland restart, rest is conserved */
 
@@ -40,6 +58,15 @@ struct wlr_xwayland_server {
 
 	struct wl_display *wl_display;
 	struct wl_event_source *idle_source;
+	struct wl_event_source *spare_timer;
+
+	struct {
+		uint32_t starts;
+		uint32_t spare_starts, spare_uses, spare_teardowns;
+		// Time between the last start of Xwayland and it being ready, in
+		// milliseconds
+		int64_t last_startup_msec;
+	} stats;
 
 	struct {
 		struct wl_signal start;
@@ -168,6 +168,18 @@ struct wlr_xwayland_surface {
 	} events;
 
 	void *data;
+
+	// private state
+
+	// Requests batched until the XWM flushes its connection
+	struct {
+		bool configure, net_wm_state;
+		bool queued; // in wlr_xwm.dirty_surfaces
+		int16_t x, y;
+		uint16_t width, height;
+		// Size of the window before the batched configure requests
+		uint16_t configured_width, configured_height;
+	} pending;
 };
 
 struct wlr_xwayland_surface_configure_event {
@@ -222,6 +234,11 @@ void wlr_xwayland_surface_activate(struct wlr_xwayland_surface *surface,
 void wlr_xwayland_surface_restack(struct wlr_xwayland_surface *surface,
 	struct wlr_xwayland_surface *sibling, enum xcb_stack_mode_t mode);
 
+/**
+ * Request the X11 window to be moved and resized. The request is sent to the
+ * X server at the end of the current event loop iteration, consecutive
+ * requests for the same window are merged.
+ */
 void wlr_xwayland_surface_configure(struct wlr_xwayland_surface *surface,
 	int16_t x, int16_t y, uint16_t width, uint16_t height);
 
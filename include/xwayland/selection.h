@@ -3,7 +3,10 @@
 
 #include <xcb/xfixes.h>
 
-#define INCR_CHUNK_SIZE (64 * 1024)
+// Bounds of the size of the chunks of selection data, the actual size depends
+// on the maximum request length of the X server
+#define MIN_INCR_CHUNK_SIZE (64 * 1024)
+#define MAX_INCR_CHUNK_SIZE (1024 * 1024)
 
 #define XDND_VERSION 5
 
@@ -22,12 +25,20 @@ struct wlr_xwm_selection_transfer {
 	struct wl_event_source *event_source;
 	struct wl_list link;
 
+	// Transferred bytes and start time, for throughput stats
+	size_t transferred;
+	int64_t start_msec;
+
 	// when sending to x11
 	xcb_selection_request_event_t request;
 
 	// when receiving from x11
 	int property_start;
 	xcb_get_property_reply_t *property_reply;
+	// Offset of the next slice of the property to read, in 32-bit units
+	uint32_t property_offset;
+	// A new INCR chunk was announced while the previous one was written
+	bool incr_chunk_pending;
 	xcb_window_t incoming_window;
 };
 
@@ -57,6 +68,8 @@ void xwm_selection_transfer_init(struct wlr_xwm_selection_transfer *transfer,
 	struct wlr_xwm_selection *selection);
 void xwm_selection_transfer_destroy(
 	struct wlr_xwm_selection_transfer *transfer);
+void xwm_selection_transfer_log_stats(
+	struct wlr_xwm_selection_transfer *transfer);
 
 void xwm_selection_transfer_destroy_outgoing(
 	struct wlr_xwm_selection_transfer *transfer);
@@ -83,6 +96,8 @@ bool primary_selection_source_is_xwayland(
 
 void xwm_seat_handle_start_drag(struct wlr_xwm *xwm, struct wlr_drag *drag);
 
+size_t xwm_selection_get_chunk_size(struct wlr_xwm *xwm);
+
 void xwm_selection_init(struct wlr_xwm_selection *selection,
 	struct wlr_xwm *xwm, xcb_atom_t atom);
 void xwm_selection_finish(struct wlr_xwm_selection *selection);
@@ -106,6 +106,8 @@ struct wlr_xwm {
 	xcb_render_pictformat_t render_format_id;
 	xcb_cursor_t cursor;
 
+	// Size of the selection data chunks sent in a single property
+	size_t selection_chunk_size;
 	struct wlr_xwm_selection clipboard_selection;
 	struct wlr_xwm_selection primary_selection;
 	struct wlr_xwm_selection dnd_selection;
@@ -114,10 +116,27 @@ struct wlr_xwm {
 
 	// Surfaces in creation order
 	struct wl_list surfaces; // wlr_xwayland_surface::link
+	// Open-addressing hash map from window IDs to surfaces
+	struct wlr_xwayland_surface **surface_map;
+	size_t surface_map_cap, surface_map_len;
 	// Surfaces in bottom-to-top stacking order, for _NET_CLIENT_LIST_STACKING
 	struct wl_list surfaces_in_stack_order; // wlr_xwayland_surface::stack_link
 	struct wl_list unpaired_surfaces; // wlr_xwayland_surface::unpaired_link
 	struct wl_list pending_startup_ids; // pending_startup_id
+	// Property reads whose replies haven't been collected yet
+	struct wl_array pending_property_reads; // struct xwm_property_read
+
+	// Mapped windows in map order, for _NET_CLIENT_LIST
+	struct wl_array client_list; // xcb_window_t
+	// Number of leading windows of client_list already written to the root
+	// window, and whether the property needs to be rewritten entirely
+	size_t client_list_committed;
+	bool client_list_replace;
+	bool client_list_dirty, client_list_stacking_dirty;
+	// Windows with batched requests, see wlr_xwayland_surface.pending
+	struct wl_array dirty_surfaces; // xcb_window_t
+	// Writes batched requests and flushes the connection
+	struct wl_event_source *flush_idle;
 
 	struct wlr_drag *drag;
 	struct wlr_xwayland_surface *drag_focus;
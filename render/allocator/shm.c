@@ -1,6 +1,10 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE // for MADV_REMOVE
 #include <assert.h>
 #include <drm_fourcc.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <unistd.h>
 #include <wlr/interfaces/wlr_buffer.h>
@@ -12,6 +16,208 @@
 #include "render/allocator/shm.h"
 #include "util/shm.h"
 
+// Buffers are carved out of arenas at least this large. Pages of shm files
+// are only committed when touched, so unused arena space is cheap.
+#define SHM_ARENA_MIN_SIZE (32 * 1024 * 1024)
+// Row alignment in bytes, suitable for cache lines and SIMD loads
+#define SHM_STRIDE_ALIGN 64
+
+struct wlr_shm_range {
+	size_t offset, size;
+};
+
+struct wlr_shm_arena {
+	struct wlr_shm_allocator *allocator; // NULL if destroyed
+	struct wl_list link; // wlr_shm_allocator.arenas
+
+	int fd;
+	void *data;
+	size_t size;
+
+	struct wl_array free_ranges; // struct wlr_shm_range, sorted by offset
+	size_t buffers_len;
+};
+
+static size_t round_up(size_t value, size_t align) {
+	return (value + align - 1) / align * align;
+}
+
+static size_t gcd(size_t a, size_t b) {
+	while (b != 0) {
+		size_t tmp = a % b;
+		a = b;
+		b = tmp;
+	}
+	return a;
+}
+
+static struct wlr_shm_arena *arena_create(struct wlr_shm_allocator *allocator,
+		size_t size) {
+	struct wlr_shm_arena *arena = calloc(1, sizeof(*arena));
+	if (arena == NULL) {
+		return NULL;
+	}
+
+	arena->size = size;
+	arena->fd = allocate_shm_file(size);
+	if (arena->fd < 0) {
+		free(arena);
+		return NULL;
+	}
+
+	arena->data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		arena->fd, 0);
+	if (arena->data == MAP_FAILED) {
+		wlr_log_errno(WLR_ERROR, "mmap failed");
+		close(arena->fd);
+		free(arena);
+		return NULL;
+	}
+
+	wl_array_init(&arena->free_ranges);
+	struct wlr_shm_range *range =
+		wl_array_add(&arena->free_ranges, sizeof(*range));
+	if (range == NULL) {
+		munmap(arena->data, arena->size);
+		close(arena->fd);
+		free(arena);
+		return NULL;
+	}
+	*range = (struct wlr_shm_range){ .offset = 0, .size = size };
+
+	arena->allocator = allocator;
+	wl_list_insert(&allocator->arenas, &arena->link);
+
+	wlr_log(WLR_DEBUG, "Created %zu byte shm arena", size);
+	return arena;
+}
+
+static void arena_destroy(struct wlr_shm_arena *arena) {
+	assert(arena->buffers_len == 0);
+	wl_list_remove(&arena->link);
+	wl_array_release(&arena->free_ranges);
+	munmap(arena->data, arena->size);
+	close(arena->fd);
+	free(arena);
+}
+
+static bool arena_is_empty(struct wlr_shm_arena *arena) {
+	return arena->buffers_len == 0;
+}
+
+static bool arena_alloc(struct wlr_shm_arena *arena, size_t size,
+		size_t *offset) {
+	// First fit
+	struct wlr_shm_range *range;
+	wl_array_for_each(range, &arena->free_ranges) {
+		if (range->size < size) {
+			continue;
+		}
+
+		*offset = range->offset;
+		range->offset += size;
+		range->size -= size;
+		if (range->size == 0) {
+			size_t i = range - (struct wlr_shm_range *)arena->free_ranges.data;
+			size_t len = arena->free_ranges.size / sizeof(*range);
+			memmove(range, range + 1, (len - i - 1) * sizeof(*range));
+			arena->free_ranges.size -= sizeof(*range);
+		}
+		arena->buffers_len++;
+		return true;
+	}
+	return false;
+}
+
+/**
+ * Give the pages entirely within a free range back to the system. The range
+ * stays mapped and reads back as zeroes.
+ */
+static void arena_release_range(struct wlr_shm_arena *arena,
+		const struct wlr_shm_range *range) {
+#ifdef MADV_REMOVE
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	size_t start = round_up(range->offset, page_size);
+	size_t end = (range->offset + range->size) / page_size * page_size;
+	if (start >= end) {
+		return;
+	}
+	if (madvise((char *)arena->data + start, end - start, MADV_REMOVE) != 0) {
+		wlr_log_errno(WLR_DEBUG, "madvise(MADV_REMOVE) failed");
+	}
+#endif
+}
+
+static void arena_free(struct wlr_shm_arena *arena, size_t offset, size_t size) {
+	assert(arena->buffers_len > 0);
+	arena->buffers_len--;
+
+	struct wlr_shm_range *ranges = arena->free_ranges.data;
+	size_t len = arena->free_ranges.size / sizeof(*ranges);
+
+	size_t i = 0;
+	while (i < len && ranges[i].offset < offset) {
+		i++;
+	}
+
+	bool merge_prev = i > 0 && ranges[i - 1].offset + ranges[i - 1].size == offset;
+	bool merge_next = i < len && offset + size == ranges[i].offset;
+	struct wlr_shm_range *merged;
+	if (merge_prev && merge_next) {
+		ranges[i - 1].size += size + ranges[i].size;
+		memmove(&ranges[i], &ranges[i + 1], (len - i - 1) * sizeof(*ranges));
+		arena->free_ranges.size -= sizeof(*ranges);
+		merged = &ranges[i - 1];
+	} else if (merge_prev) {
+		ranges[i - 1].size += size;
+		merged = &ranges[i - 1];
+	} else if (merge_next) {
+		ranges[i].offset = offset;
+		ranges[i].size += size;
+		merged = &ranges[i];
+	} else {
+		if (wl_array_add(&arena->free_ranges, sizeof(*ranges)) == NULL) {
+			// The range is leaked until the arena is destroyed
+			wlr_log(WLR_ERROR, "Allocation failed");
+			arena_release_range(arena,
+				&(struct wlr_shm_range){ .offset = offset, .size = size });
+			return;
+		}
+		ranges = arena->free_ranges.data;
+		memmove(&ranges[i + 1], &ranges[i], (len - i) * sizeof(*ranges));
+		ranges[i] = (struct wlr_shm_range){ .offset = offset, .size = size };
+		merged = &ranges[i];
+	}
+
+	// Pages shared with a neighbouring free range are released too, so that
+	// freed buffers don't keep tmpfs pages resident
+	arena_release_range(arena, merged);
+}
+
+/**
+ * Destroy empty arenas. If the allocator is still alive and freed pages are
+ * given back to the system, one empty arena is kept around so that re-creating
+ * a swapchain doesn't need new mappings.
+ */
+static void allocator_trim_arenas(struct wlr_shm_allocator *allocator) {
+#ifdef MADV_REMOVE
+	bool keep = true;
+#else
+	bool keep = false;
+#endif
+	struct wlr_shm_arena *arena, *tmp;
+	wl_list_for_each_safe(arena, tmp, &allocator->arenas, link) {
+		if (!arena_is_empty(arena)) {
+			continue;
+		}
+		if (keep) {
+			keep = false;
+			continue;
+		}
+		arena_destroy(arena);
+	}
+}
+
 static const struct wlr_buffer_impl buffer_impl;
 
 static struct wlr_shm_buffer *shm_buffer_from_buffer(
@@ -22,8 +228,13 @@ static struct wlr_shm_buffer *shm_buffer_from_buffer(
 
 static void buffer_destroy(struct wlr_buffer *wlr_buffer) {
 	struct wlr_shm_buffer *buffer = shm_buffer_from_buffer(wlr_buffer);
-	munmap(buffer->data, buffer->size);
-	close(buffer->shm.fd);
+	struct wlr_shm_arena *arena = buffer->arena;
+	arena_free(arena, buffer->shm.offset, buffer->size);
+	if (arena->allocator != NULL) {
+		allocator_trim_arenas(arena->allocator);
+	} else if (arena_is_empty(arena)) {
+		arena_destroy(arena);
+	}
 	free(buffer);
 }
 
@@ -54,9 +265,31 @@ static const struct wlr_buffer_impl buffer_impl = {
 	.end_data_ptr_access = shm_buffer_end_data_ptr_access,
 };
 
+static struct wlr_shm_allocator *shm_allocator_from_allocator(
+		struct wlr_allocator *wlr_allocator);
+
+static int32_t aligned_stride(const struct wlr_pixel_format_info *info,
+		int32_t width) {
+	int32_t min_stride = pixel_format_info_min_stride(info, width);
+	if (min_stride <= 0) {
+		return 0;
+	}
+	// The stride must stay a multiple of the block size
+	size_t align = SHM_STRIDE_ALIGN / gcd(SHM_STRIDE_ALIGN,
+		info->bytes_per_block) * info->bytes_per_block;
+	size_t stride = round_up(min_stride, align);
+	if (stride > INT32_MAX) {
+		return min_stride;
+	}
+	return stride;
+}
+
 static struct wlr_buffer *allocator_create_buffer(
 		struct wlr_allocator *wlr_allocator, int width, int height,
 		const struct wlr_drm_format *format) {
+	struct wlr_shm_allocator *allocator =
+		shm_allocator_from_allocator(wlr_allocator);
+
 	const struct wlr_pixel_format_info *info =
 		drm_get_pixel_format_info(format->format);
 	if (info == NULL) {
@@ -64,41 +297,79 @@ static struct wlr_buffer *allocator_create_buffer(
 		return NULL;
 	}
 
+	int32_t stride = aligned_stride(info, width);
+	if (stride <= 0 || height <= 0) {
+		return NULL;
+	}
+
 	struct wlr_shm_buffer *buffer = calloc(1, sizeof(*buffer));
 	if (buffer == NULL) {
 		return NULL;
 	}
 	wlr_buffer_init(&buffer->base, &buffer_impl, width, height);
 
-	// TODO: consider using a single file for multiple buffers
-	int stride = pixel_format_info_min_stride(info, width); // TODO: align?
-	buffer->size = stride * height;
-	buffer->shm.fd = allocate_shm_file(buffer->size);
-	if (buffer->shm.fd < 0) {
-		free(buffer);
-		return NULL;
+	// Keep buffers page-aligned within the arena
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	buffer->size = round_up((size_t)stride * height, page_size);
+
+	size_t offset = 0;
+	struct wlr_shm_arena *arena = NULL, *iter;
+	wl_list_for_each(iter, &allocator->arenas, link) {
+		if (arena_alloc(iter, buffer->size, &offset)) {
+			arena = iter;
+			break;
+		}
+	}
+	if (arena == NULL) {
+		size_t arena_size = buffer->size > SHM_ARENA_MIN_SIZE ?
+			buffer->size : SHM_ARENA_MIN_SIZE;
+		arena = arena_create(allocator, arena_size);
+		if (arena == NULL || !arena_alloc(arena, buffer->size, &offset)) {
+			free(buffer);
+			return NULL;
+		}
 	}
 
+	buffer->arena = arena;
+	buffer->data = (char *)arena->data + offset;
+
+	buffer->shm.fd = arena->fd;
 	buffer->shm.format = format->format;
 	buffer->shm.width = width;
 	buffer->shm.height = height;
 	buffer->shm.stride = stride;
-	buffer->shm.offset = 0;
-
-	buffer->data = mmap(NULL, buffer->size, PROT_READ | PROT_WRITE, MAP_SHARED,
-		buffer->shm.fd, 0);
-	if (buffer->data == MAP_FAILED) {
-		wlr_log_errno(WLR_ERROR, "mmap failed");
-		close(buffer->shm.fd);
-		free(buffer);
-		return NULL;
-	}
+	buffer->shm.offset = offset;
 
 	return &buffer->base;
 }
 
+static const struct wlr_allocator_interface allocator_impl;
+
+static struct wlr_shm_allocator *shm_allocator_from_allocator(
+		struct wlr_allocator *wlr_allocator) {
+	assert(wlr_allocator->impl == &allocator_impl);
+	struct wlr_shm_allocator *allocator =
+		wl_container_of(wlr_allocator, allocator, base);
+	return allocator;
+}
+
 static void allocator_destroy(struct wlr_allocator *wlr_allocator) {
-	free(wlr_allocator);
+	struct wlr_shm_allocator *allocator =
+		shm_allocator_from_allocator(wlr_allocator);
+
+	// Arenas still used by buffers are destroyed with their last buffer
+	struct wlr_shm_arena *arena, *tmp;
+	wl_list_for_each_safe(arena, tmp, &allocator->arenas, link) {
+		if (arena_is_empty(arena)) {
+			arena_destroy(arena);
+		} else {
+			arena->allocator = NULL;
+			wl_list_remove(&arena->link);
+			wl_list_init(&arena->link);
+		}
+	}
+
+	free(allocator);
 }
 
 static const struct wlr_allocator_interface allocator_impl = {
@@ -113,6 +384,7 @@ struct wlr_allocator *wlr_shm_allocator_create(void) {
 	}
 	wlr_allocator_init(&allocator->base, &allocator_impl,
 		WLR_BUFFER_CAP_DATA_PTR | WLR_BUFFER_CAP_SHM);
+	wl_list_init(&allocator->arenas);
 
 	wlr_log(WLR_DEBUG, "Created shm allocator");
 	return &allocator->base;
@@ -0,0 +1,365 @@
+#include <assert.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_matrix.h>
+#include <wlr/util/log.h>
+#include "render/gles2.h"
+
+// Number of vertices per quad, drawn as two triangles
+#define QUAD_VERTS_LEN 6
+
+struct wlr_gles2_render_vertex {
+	GLfloat x, y; // buffer-local position
+	GLfloat s, t; // normalized texture coordinates, unused for rects
+};
+
+struct wlr_gles2_render_draw {
+	// NULL for rects
+	struct wlr_gles2_texture *texture;
+	struct wlr_gles2_tex_shader *shader;
+	float color[4]; // color for rects, color[0] is the alpha for textures
+	bool blend;
+
+	GLint first; // first vertex
+	GLsizei count; // number of vertices
+};
+
+static const struct wlr_render_pass_impl render_pass_impl;
+
+static struct wlr_gles2_render_pass *get_render_pass(struct wlr_render_pass *wlr_pass) {
+	assert(wlr_pass->impl == &render_pass_impl);
+	struct wlr_gles2_render_pass *pass = wl_container_of(wlr_pass, pass, base);
+	return pass;
+}
+
+static struct wlr_gles2_tex_shader *get_tex_shader(struct wlr_gles2_renderer *renderer,
+		struct wlr_gles2_texture *texture) {
+	switch (texture->target) {
+	case GL_TEXTURE_2D:
+		if (texture->has_alpha) {
+			return &renderer->shaders.tex_rgba;
+		} else {
+			return &renderer->shaders.tex_rgbx;
+		}
+	case GL_TEXTURE_EXTERNAL_OES:
+		// EGL_EXT_image_dma_buf_import_modifiers requires
+		// GL_OES_EGL_image_external
+		assert(renderer->exts.OES_egl_image_external);
+		return &renderer->shaders.tex_ext;
+	}
+	abort();
+}
+
+static void get_clip_region(struct wlr_gles2_render_pass *pass,
+		const pixman_region32_t *in, pixman_region32_t *out) {
+	if (in != NULL) {
+		pixman_region32_init(out);
+		pixman_region32_copy(out, in);
+	} else {
+		pixman_region32_init_rect(out, 0, 0, pass->width, pass->height);
+	}
+}
+
+/**
+ * Get the draw call the next quads should be appended to. Consecutive quads
+ * sharing the same texture, shader and uniforms are merged into a single draw
+ * call.
+ */
+static struct wlr_gles2_render_draw *get_draw(struct wlr_gles2_render_pass *pass,
+		const struct wlr_gles2_render_draw *key) {
+	if (pass->draws.size > 0) {
+		struct wlr_gles2_render_draw *last = (void *)((char *)pass->draws.data +
+			pass->draws.size - sizeof(*last));
+		if (last->texture == key->texture && last->shader == key->shader &&
+				last->blend == key->blend &&
+				memcmp(last->color, key->color, sizeof(key->color)) == 0) {
+			return last;
+		}
+	}
+
+	struct wlr_gles2_render_draw *draw = wl_array_add(&pass->draws, sizeof(*draw));
+	if (draw == NULL) {
+		return NULL;
+	}
+	*draw = *key;
+	draw->first = pass->verts.size / sizeof(struct wlr_gles2_render_vertex);
+	draw->count = 0;
+	return draw;
+}
+
+static struct wlr_gles2_render_vertex *add_quad(struct wlr_gles2_render_pass *pass,
+		struct wlr_gles2_render_draw *draw) {
+	struct wlr_gles2_render_vertex *verts =
+		wl_array_add(&pass->verts, QUAD_VERTS_LEN * sizeof(*verts));
+	if (verts == NULL) {
+		return NULL;
+	}
+	draw->count += QUAD_VERTS_LEN;
+	return verts;
+}
+
+static void set_quad_positions(struct wlr_gles2_render_vertex verts[static QUAD_VERTS_LEN],
+		const pixman_box32_t *rect) {
+	// Corners in order top left, top right, bottom left, bottom right
+	const GLfloat corners[4][2] = {
+		{ rect->x1, rect->y1 },
+		{ rect->x2, rect->y1 },
+		{ rect->x1, rect->y2 },
+		{ rect->x2, rect->y2 },
+	};
+	static const int indices[QUAD_VERTS_LEN] = { 0, 1, 2, 2, 1, 3 };
+	for (size_t i = 0; i < QUAD_VERTS_LEN; i++) {
+		verts[i].x = corners[indices[i]][0];
+		verts[i].y = corners[indices[i]][1];
+		verts[i].s = verts[i].t = 0;
+	}
+}
+
+static void render_pass_add_texture(struct wlr_render_pass *wlr_pass,
+		const struct wlr_render_texture_options *options) {
+	struct wlr_gles2_render_pass *pass = get_render_pass(wlr_pass);
+	struct wlr_gles2_renderer *renderer = pass->renderer;
+	struct wlr_gles2_texture *texture = gles2_get_texture(options->texture);
+	assert(texture->renderer == renderer);
+
+	struct wlr_fbox src_box;
+	wlr_render_texture_options_get_src_box(options, &src_box);
+	struct wlr_box dst_box;
+	wlr_render_texture_options_get_dst_box(options, &dst_box);
+	float alpha = wlr_render_texture_options_get_alpha(options);
+
+	pixman_region32_t clip;
+	get_clip_region(pass, options->clip, &clip);
+	pixman_region32_intersect_rect(&clip, &clip,
+		dst_box.x, dst_box.y, dst_box.width, dst_box.height);
+
+	int rects_len = 0;
+	const pixman_box32_t *rects = pixman_region32_rectangles(&clip, &rects_len);
+	if (rects_len == 0) {
+		goto out;
+	}
+
+	struct wlr_gles2_render_draw key = {
+		.texture = texture,
+		.shader = get_tex_shader(renderer, texture),
+		.color = { alpha },
+		.blend = texture->has_alpha || alpha < 1.0,
+	};
+	struct wlr_gles2_render_draw *draw = get_draw(pass, &key);
+	if (draw == NULL) {
+		goto out;
+	}
+
+	// Same matrix as the legacy path, mapping the unit quad to the
+	// destination box. Its inverse maps buffer-local positions back onto the
+	// unit quad, which is then mapped onto the source box.
+	float proj[9], matrix[9];
+	wlr_matrix_identity(proj);
+	wlr_matrix_project_box(matrix, &dst_box, options->transform, 0.0, proj);
+
+	float det = matrix[0] * matrix[4] - matrix[1] * matrix[3];
+	if (det == 0) {
+		goto out;
+	}
+	const float inv[4] = {
+		matrix[4] / det, -matrix[1] / det,
+		-matrix[3] / det, matrix[0] / det,
+	};
+
+	const struct wlr_texture *wlr_texture = options->texture;
+	for (int i = 0; i < rects_len; i++) {
+		struct wlr_gles2_render_vertex *verts = add_quad(pass, draw);
+		if (verts == NULL) {
+			break;
+		}
+		set_quad_positions(verts, &rects[i]);
+
+		for (size_t j = 0; j < QUAD_VERTS_LEN; j++) {
+			float dx = verts[j].x - matrix[2];
+			float dy = verts[j].y - matrix[5];
+			float u = inv[0] * dx + inv[1] * dy;
+			float v = inv[2] * dx + inv[3] * dy;
+			verts[j].s = (src_box.x + u * src_box.width) / wlr_texture->width;
+			verts[j].t = (src_box.y + v * src_box.height) / wlr_texture->height;
+		}
+	}
+
+out:
+	pixman_region32_fini(&clip);
+}
+
+static void render_pass_add_rect(struct wlr_render_pass *wlr_pass,
+		const struct wlr_render_rect_options *options) {
+	struct wlr_gles2_render_pass *pass = get_render_pass(wlr_pass);
+
+	pixman_region32_t clip;
+	get_clip_region(pass, options->clip, &clip);
+	pixman_region32_intersect_rect(&clip, &clip,
+		options->box.x, options->box.y, options->box.width, options->box.height);
+
+	int rects_len = 0;
+	const pixman_box32_t *rects = pixman_region32_rectangles(&clip, &rects_len);
+	if (rects_len == 0) {
+		goto out;
+	}
+
+	struct wlr_gles2_render_draw key = {
+		.color = {
+			options->color.r,
+			options->color.g,
+			options->color.b,
+			options->color.a,
+		},
+		.blend = options->blend_mode == WLR_RENDER_BLEND_MODE_PREMULTIPLIED &&
+			options->color.a < 1.0,
+	};
+	struct wlr_gles2_render_draw *draw = get_draw(pass, &key);
+	if (draw == NULL) {
+		goto out;
+	}
+
+	for (int i = 0; i < rects_len; i++) {
+		struct wlr_gles2_render_vertex *verts = add_quad(pass, draw);
+		if (verts == NULL) {
+			break;
+		}
+		set_quad_positions(verts, &rects[i]);
+	}
+
+out:
+	pixman_region32_fini(&clip);
+}
+
+static void render_draw(struct wlr_gles2_render_pass *pass,
+		const struct wlr_gles2_render_draw *draw, const float proj[static 9]) {
+	struct wlr_gles2_renderer *renderer = pass->renderer;
+	const GLsizei stride = sizeof(struct wlr_gles2_render_vertex);
+
+	if (draw->blend) {
+		glEnable(GL_BLEND);
+	} else {
+		glDisable(GL_BLEND);
+	}
+
+	GLint pos_attrib, tex_attrib = -1;
+	if (draw->texture != NULL) {
+		struct wlr_gles2_texture *texture = draw->texture;
+		struct wlr_gles2_tex_shader *shader = draw->shader;
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(texture->target, texture->tex);
+		glTexParameteri(texture->target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+		glUseProgram(shader->program);
+		glUniformMatrix3fv(shader->proj, 1, GL_FALSE, proj);
+		glUniform1i(shader->tex, 0);
+		glUniform1f(shader->alpha, draw->color[0]);
+
+		pos_attrib = shader->pos_attrib;
+		tex_attrib = shader->tex_attrib;
+	} else {
+		glUseProgram(renderer->shaders.quad.program);
+		glUniformMatrix3fv(renderer->shaders.quad.proj, 1, GL_FALSE, proj);
+		glUniform4f(renderer->shaders.quad.color, draw->color[0],
+			draw->color[1], draw->color[2], draw->color[3]);
+
+		pos_attrib = renderer->shaders.quad.pos_attrib;
+	}
+
+	glVertexAttribPointer(pos_attrib, 2, GL_FLOAT, GL_FALSE, stride,
+		(void *)offsetof(struct wlr_gles2_render_vertex, x));
+	glEnableVertexAttribArray(pos_attrib);
+	if (tex_attrib >= 0) {
+		glVertexAttribPointer(tex_attrib, 2, GL_FLOAT, GL_FALSE, stride,
+			(void *)offsetof(struct wlr_gles2_render_vertex, s));
+		glEnableVertexAttribArray(tex_attrib);
+	}
+
+	glDrawArrays(GL_TRIANGLES, draw->first, draw->count);
+
+	glDisableVertexAttribArray(pos_attrib);
+	if (tex_attrib >= 0) {
+		glDisableVertexAttribArray(tex_attrib);
+	}
+	if (draw->texture != NULL) {
+		glBindTexture(draw->texture->target, 0);
+	}
+}
+
+static bool render_pass_submit(struct wlr_render_pass *wlr_pass) {
+	struct wlr_gles2_render_pass *pass = get_render_pass(wlr_pass);
+	struct wlr_gles2_renderer *renderer = pass->renderer;
+
+	if (pass->draws.size > 0) {
+		// Vertices are in buffer-local coordinates, so the projection is the
+		// same for all draws. OpenGL ES 2 requires the glUniformMatrix3fv
+		// transpose parameter to be set to GL_FALSE.
+		float proj[9];
+		wlr_matrix_transpose(proj, renderer->projection);
+
+		push_gles2_debug(renderer);
+
+		glBindBuffer(GL_ARRAY_BUFFER, renderer->vbo);
+		glBufferData(GL_ARRAY_BUFFER, pass->verts.size, pass->verts.data,
+			GL_STREAM_DRAW);
+
+		struct wlr_gles2_render_draw *draw;
+		wl_array_for_each(draw, &pass->draws) {
+			render_draw(pass, draw, proj);
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		pop_gles2_debug(renderer);
+	}
+
+	wlr_renderer_end(&renderer->wlr_renderer);
+
+	wl_array_release(&pass->draws);
+	wl_array_release(&pass->verts);
+	free(pass);
+	return true;
+}
+
+static const struct wlr_render_pass_impl render_pass_impl = {
+	.submit = render_pass_submit,
+	.add_texture = render_pass_add_texture,
+	.add_rect = render_pass_add_rect,
+};
+
+struct wlr_gles2_render_pass *begin_gles2_buffer_pass(
+		struct wlr_gles2_renderer *renderer, struct wlr_buffer *buffer) {
+	struct wlr_renderer *wlr_renderer = &renderer->wlr_renderer;
+	if (wlr_renderer->rendering) {
+		return NULL;
+	}
+
+	struct wlr_gles2_render_pass *pass = calloc(1, sizeof(*pass));
+	if (pass == NULL) {
+		return NULL;
+	}
+
+	wlr_render_pass_init(&pass->base, &render_pass_impl);
+	pass->renderer = renderer;
+	pass->width = buffer->width;
+	pass->height = buffer->height;
+	wl_array_init(&pass->draws);
+	wl_array_init(&pass->verts);
+
+	if (!wlr_renderer_begin_with_buffer(wlr_renderer, buffer)) {
+		free(pass);
+		return NULL;
+	}
+
+	if (renderer->vbo == 0) {
+		push_gles2_debug(renderer);
+		glGenBuffers(1, &renderer->vbo);
+		pop_gles2_debug(renderer);
+	}
+
+	return pass;
+}
@@ -166,8 +166,92 @@ static void gles2_texture_unref(struct wlr_texture *wlr_texture) {
 	}
 }
 
+static bool gles2_texture_read_pixels(struct wlr_texture *wlr_texture,
+		uint32_t drm_format, uint32_t stride, void *data) {
+	struct wlr_gles2_texture *texture = gles2_get_texture(wlr_texture);
+	struct wlr_gles2_renderer *renderer = texture->renderer;
+
+	// External textures can't be attached to a framebuffer
+	if (texture->target != GL_TEXTURE_2D) {
+		return false;
+	}
+
+	const struct wlr_gles2_pixel_format *fmt =
+		get_gles2_format_from_drm(drm_format);
+	if (fmt == NULL || !is_gles2_pixel_format_supported(renderer, fmt)) {
+		wlr_log(WLR_ERROR, "Cannot read pixels: unsupported pixel format 0x%"PRIX32, drm_format);
+		return false;
+	}
+
+	if (fmt->gl_format == GL_BGRA_EXT && !renderer->exts.EXT_read_format_bgra) {
+		wlr_log(WLR_ERROR,
+			"Cannot read pixels: missing GL_EXT_read_format_bgra extension");
+		return false;
+	}
+
+	const struct wlr_pixel_format_info *drm_fmt =
+		drm_get_pixel_format_info(fmt->drm_format);
+	assert(drm_fmt);
+	if (pixel_format_info_pixels_per_block(drm_fmt) != 1) {
+		wlr_log(WLR_ERROR, "Cannot read pixels: block formats are not supported");
+		return false;
+	}
+
+	uint32_t width = wlr_texture->width;
+	uint32_t height = wlr_texture->height;
+	if (!pixel_format_info_check_stride(drm_fmt, stride, width)) {
+		return false;
+	}
+
+	struct wlr_egl_context prev_ctx;
+	wlr_egl_save_context(&prev_ctx);
+	wlr_egl_make_current(renderer->egl);
+
+	push_gles2_debug(renderer);
+
+	GLint prev_fbo;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prev_fbo);
+
+	GLuint fbo;
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+		GL_TEXTURE_2D, texture->tex, 0);
+
+	bool ok = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	if (ok) {
+		glGetError(); // Clear the error flag
+
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		unsigned char *p = data;
+		if (pixel_format_info_min_stride(drm_fmt, width) == stride) {
+			glReadPixels(0, 0, width, height, fmt->gl_format, fmt->gl_type, p);
+		} else {
+			// GLES2 doesn't support GL_PACK_ROW_LENGTH
+			for (uint32_t y = 0; y < height; y++) {
+				glReadPixels(0, y, width, 1, fmt->gl_format, fmt->gl_type,
+					p + y * stride);
+			}
+		}
+
+		ok = glGetError() == GL_NO_ERROR;
+	} else {
+		wlr_log(WLR_DEBUG, "Cannot read pixels: texture isn't color-renderable");
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, prev_fbo);
+	glDeleteFramebuffers(1, &fbo);
+
+	pop_gles2_debug(renderer);
+
+	wlr_egl_restore_context(&prev_ctx);
+
+	return ok;
+}
+
 static const struct wlr_texture_impl texture_impl = {
 	.update_from_buffer = gles2_texture_update_from_buffer,
+	.read_pixels = gles2_texture_read_pixels,
 	.destroy = gles2_texture_unref,
 };
 
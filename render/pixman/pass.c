@@ -1,7 +1,35 @@
 #include <assert.h>
 #include <stdlib.h>
+#include <wlr/util/log.h>
 #include "render/pixman.h"
 
+// Number of bands per thread, to balance uneven work between bands
+#define TILED_BANDS_PER_THREAD 4
+
+enum wlr_pixman_render_op_type {
+	WLR_PIXMAN_RENDER_OP_TEXTURE,
+	WLR_PIXMAN_RENDER_OP_RECT,
+};
+
+struct wlr_pixman_render_op {
+	enum wlr_pixman_render_op_type type;
+	// The alpha and clip pointers are invalid, use the fields below instead
+	struct wlr_render_texture_options texture;
+	struct wlr_render_rect_options rect;
+	float alpha;
+	bool has_clip;
+	pixman_region32_t clip;
+
+	// Set during replay
+	bool skip; // couldn't access the texture data
+	bool end_access; // this op began the texture data access
+};
+
+struct tiled_replay {
+	struct wlr_pixman_render_pass *pass;
+	int band_height;
+};
+
 static const struct wlr_render_pass_impl render_pass_impl;
 
 static struct wlr_pixman_render_pass *get_render_pass(struct wlr_render_pass *wlr_pass) {
@@ -16,27 +44,14 @@ static struct wlr_pixman_texture *get_texture(struct wlr_texture *wlr_texture) {
 	return texture;
 }
 
-static bool render_pass_submit(struct wlr_render_pass *wlr_pass) {
-	struct wlr_pixman_render_pass *pass = get_render_pass(wlr_pass);
-
-	wlr_buffer_end_data_ptr_access(pass->buffer->buffer);
-	wlr_buffer_unlock(pass->buffer->buffer);
-	free(pass);
-
-	return true;
-}
-
-static void render_pass_add_texture(struct wlr_render_pass *wlr_pass,
+/**
+ * Composite a texture onto dst. dst may cover only part of the render buffer
+ * of size buffer_width x buffer_height, starting at row offset_y. The clip
+ * region is relative to dst.
+ */
+static void composite_texture(pixman_image_t *dst, int buffer_width,
+		int buffer_height, int offset_y, pixman_image_t *src,
 		const struct wlr_render_texture_options *options) {
-	struct wlr_pixman_render_pass *pass = get_render_pass(wlr_pass);
-	struct wlr_pixman_texture *texture = get_texture(options->texture);
-	struct wlr_pixman_buffer *buffer = pass->buffer;
-
-	if (texture->buffer != NULL && !begin_pixman_data_ptr_access(texture->buffer,
-			&texture->image, WLR_BUFFER_DATA_PTR_ACCESS_READ)) {
-		return;
-	}
-
 	struct wlr_fbox src_fbox;
 	wlr_render_texture_options_get_src_box(options, &src_fbox);
 	struct wlr_box src_box = {
@@ -59,7 +74,7 @@ static void render_pass_add_texture(struct wlr_render_pass *wlr_pass,
 
 	struct wlr_box orig_box;
 	wlr_box_transform(&orig_box, &dst_box, options->transform,
-		buffer->buffer->width, buffer->buffer->height);
+		buffer_width, buffer_height);
 
 	int32_t dest_x, dest_y, width, height;
 	if (options->transform != WL_OUTPUT_TRANSFORM_NORMAL ||
@@ -75,20 +90,20 @@ static void render_pass_add_texture(struct wlr_render_pass *wlr_pass,
 		case WL_OUTPUT_TRANSFORM_FLIPPED_90:
 			tr_cos = 0;
 			tr_sin = 1;
-			tr_x = buffer->buffer->height;
+			tr_x = buffer_height;
 			break;
 		case WL_OUTPUT_TRANSFORM_180:
 		case WL_OUTPUT_TRANSFORM_FLIPPED_180:
 			tr_cos = -1;
 			tr_sin = 0;
-			tr_x = buffer->buffer->width;
-			tr_y = buffer->buffer->height;
+			tr_x = buffer_width;
+			tr_y = buffer_height;
 			break;
 		case WL_OUTPUT_TRANSFORM_270:
 		case WL_OUTPUT_TRANSFORM_FLIPPED_270:
 			tr_cos = 0;
 			tr_sin = -1;
-			tr_y = buffer->buffer->width;
+			tr_y = buffer_width;
 			break;
 		}
 
@@ -107,40 +122,38 @@ static void render_pass_add_texture(struct wlr_render_pass *wlr_pass,
 		pixman_transform_scale(&transform, NULL,
 			pixman_double_to_fixed(src_box.width / (double)orig_box.width),
 			pixman_double_to_fixed(src_box.height / (double)orig_box.height));
-		pixman_image_set_transform(texture->image, &transform);
+		pixman_image_set_transform(src, &transform);
 
 		dest_x = dest_y = 0;
-		width = buffer->buffer->width;
-		height = buffer->buffer->height;
+		width = buffer_width;
+		height = buffer_height;
 	} else {
-		pixman_image_set_transform(texture->image, NULL);
+		pixman_image_set_transform(src, NULL);
 		dest_x = dst_box.x;
 		dest_y = dst_box.y;
 		width = src_box.width;
 		height = src_box.height;
 	}
 
-	pixman_image_set_clip_region32(buffer->image, (pixman_region32_t *)options->clip);
-	pixman_image_composite32(PIXMAN_OP_OVER, texture->image, mask,
-		buffer->image, src_box.x, src_box.y, 0, 0, dest_x, dest_y,
+	pixman_image_set_clip_region32(dst, (pixman_region32_t *)options->clip);
+	pixman_image_composite32(PIXMAN_OP_OVER, src, mask,
+		dst, src_box.x, src_box.y, 0, 0, dest_x, dest_y - offset_y,
 		width, height);
-	pixman_image_set_clip_region32(buffer->image, NULL);
+	pixman_image_set_clip_region32(dst, NULL);
 
-	pixman_image_set_transform(texture->image, NULL);
-
-	if (texture->buffer != NULL) {
-		wlr_buffer_end_data_ptr_access(texture->buffer);
-	}
+	pixman_image_set_transform(src, NULL);
 
 	if (mask != NULL) {
 		pixman_image_unref(mask);
 	}
 }
 
-static void render_pass_add_rect(struct wlr_render_pass *wlr_pass,
+/**
+ * Composite a rectangle onto dst, which starts at row offset_y of the render
+ * buffer. The clip region is relative to dst.
+ */
+static void composite_rect(pixman_image_t *dst, int offset_y,
 		const struct wlr_render_rect_options *options) {
-	struct wlr_pixman_render_pass *pass = get_render_pass(wlr_pass);
-	struct wlr_pixman_buffer *buffer = pass->buffer;
 	struct wlr_box box = options->box;
 
 	pixman_op_t op = 0;
@@ -163,14 +176,233 @@ static void render_pass_add_rect(struct wlr_render_pass *wlr_pass,
 
 	pixman_image_t *fill = pixman_image_create_solid_fill(&color);
 
-	pixman_image_set_clip_region32(buffer->image, (pixman_region32_t *)options->clip);
-	pixman_image_composite32(op, fill, NULL, buffer->image,
-		0, 0, 0, 0, box.x, box.y, box.width, box.height);
-	pixman_image_set_clip_region32(buffer->image, NULL);
+	pixman_image_set_clip_region32(dst, (pixman_region32_t *)options->clip);
+	pixman_image_composite32(op, fill, NULL, dst,
+		0, 0, 0, 0, box.x, box.y - offset_y, box.width, box.height);
+	pixman_image_set_clip_region32(dst, NULL);
 
 	pixman_image_unref(fill);
 }
 
+static void replay_band(void *data, size_t index) {
+	struct tiled_replay *replay = data;
+	struct wlr_pixman_render_pass *pass = replay->pass;
+	struct wlr_buffer *buffer = pass->buffer->buffer;
+	pixman_image_t *image = pass->buffer->image;
+
+	int y = index * replay->band_height;
+	int height = replay->band_height;
+	if (y + height > buffer->height) {
+		height = buffer->height - y;
+	}
+	if (height <= 0) {
+		return;
+	}
+
+	// Images can't be shared between threads, since pixman mutates their
+	// state while compositing. Create a view of the band and of each source.
+	int stride = pixman_image_get_stride(image);
+	uint32_t *bits = (uint32_t *)((char *)pixman_image_get_data(image) + y * stride);
+	pixman_image_t *dst = pixman_image_create_bits_no_clear(
+		pixman_image_get_format(image), buffer->width, height, bits, stride);
+	if (dst == NULL) {
+		wlr_log(WLR_ERROR, "Failed to create pixman image");
+		return;
+	}
+
+	pixman_region32_t clip;
+	pixman_region32_init(&clip);
+
+	struct wlr_pixman_render_op *op;
+	wl_array_for_each(op, &pass->ops) {
+		if (op->skip) {
+			continue;
+		}
+
+		if (op->has_clip) {
+			pixman_region32_copy(&clip, &op->clip);
+			pixman_region32_translate(&clip, 0, -y);
+			pixman_region32_intersect_rect(&clip, &clip,
+				0, 0, buffer->width, height);
+		} else {
+			pixman_region32_fini(&clip);
+			pixman_region32_init_rect(&clip, 0, 0, buffer->width, height);
+		}
+		if (!pixman_region32_not_empty(&clip)) {
+			continue;
+		}
+
+		switch (op->type) {
+		case WLR_PIXMAN_RENDER_OP_TEXTURE:;
+			struct wlr_render_texture_options texture_options = op->texture;
+			texture_options.alpha = &op->alpha;
+			texture_options.clip = &clip;
+
+			pixman_image_t *src_image = get_texture(op->texture.texture)->image;
+			pixman_image_t *src = pixman_image_create_bits_no_clear(
+				pixman_image_get_format(src_image),
+				pixman_image_get_width(src_image),
+				pixman_image_get_height(src_image),
+				pixman_image_get_data(src_image),
+				pixman_image_get_stride(src_image));
+			if (src == NULL) {
+				wlr_log(WLR_ERROR, "Failed to create pixman image");
+				break;
+			}
+
+			composite_texture(dst, buffer->width, buffer->height, y,
+				src, &texture_options);
+			pixman_image_unref(src);
+			break;
+		case WLR_PIXMAN_RENDER_OP_RECT:;
+			struct wlr_render_rect_options rect_options = op->rect;
+			rect_options.clip = &clip;
+			composite_rect(dst, y, &rect_options);
+			break;
+		}
+	}
+
+	pixman_region32_fini(&clip);
+	pixman_image_unref(dst);
+}
+
+static void render_pass_replay_tiled(struct wlr_pixman_render_pass *pass) {
+	struct wlr_pixman_worker_pool *workers = pass->buffer->renderer->workers;
+	struct wlr_pixman_render_op *ops = pass->ops.data;
+	size_t ops_len = pass->ops.size / sizeof(ops[0]);
+
+	// Buffer data can only be accessed once at a time: begin the access
+	// for each distinct texture up-front, and keep it until all bands are done
+	for (size_t i = 0; i < ops_len; i++) {
+		if (ops[i].type != WLR_PIXMAN_RENDER_OP_TEXTURE) {
+			continue;
+		}
+
+		struct wlr_pixman_texture *texture = get_texture(ops[i].texture.texture);
+		if (texture->buffer == NULL) {
+			continue;
+		}
+
+		bool seen = false;
+		for (size_t j = 0; j < i; j++) {
+			if (ops[j].type == WLR_PIXMAN_RENDER_OP_TEXTURE &&
+					ops[j].texture.texture == ops[i].texture.texture) {
+				ops[i].skip = ops[j].skip;
+				seen = true;
+				break;
+			}
+		}
+		if (seen) {
+			continue;
+		}
+
+		if (begin_pixman_data_ptr_access(texture->buffer, &texture->image,
+				WLR_BUFFER_DATA_PTR_ACCESS_READ)) {
+			ops[i].end_access = true;
+		} else {
+			ops[i].skip = true;
+		}
+	}
+
+	size_t threads_len = pixman_worker_pool_get_threads_len(workers) + 1;
+	size_t bands_len = threads_len * TILED_BANDS_PER_THREAD;
+	struct tiled_replay replay = {
+		.pass = pass,
+		.band_height = (pass->buffer->buffer->height + bands_len - 1) / bands_len,
+	};
+	if (replay.band_height > 0) {
+		pixman_worker_pool_run(workers, replay_band, &replay, bands_len);
+	}
+
+	for (size_t i = 0; i < ops_len; i++) {
+		if (ops[i].end_access) {
+			struct wlr_pixman_texture *texture = get_texture(ops[i].texture.texture);
+			wlr_buffer_end_data_ptr_access(texture->buffer);
+		}
+		pixman_region32_fini(&ops[i].clip);
+	}
+}
+
+static bool render_pass_submit(struct wlr_render_pass *wlr_pass) {
+	struct wlr_pixman_render_pass *pass = get_render_pass(wlr_pass);
+
+	if (pass->ops.size > 0) {
+		render_pass_replay_tiled(pass);
+	}
+	wl_array_release(&pass->ops);
+
+	wlr_buffer_end_data_ptr_access(pass->buffer->buffer);
+	wlr_buffer_unlock(pass->buffer->buffer);
+	free(pass);
+
+	return true;
+}
+
+static struct wlr_pixman_render_op *record_op(struct wlr_pixman_render_pass *pass,
+		enum wlr_pixman_render_op_type type, const pixman_region32_t *clip) {
+	struct wlr_pixman_render_op *op = wl_array_add(&pass->ops, sizeof(*op));
+	if (op == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+
+	*op = (struct wlr_pixman_render_op){
+		.type = type,
+		.has_clip = clip != NULL,
+	};
+	pixman_region32_init(&op->clip);
+	if (clip != NULL) {
+		pixman_region32_copy(&op->clip, clip);
+	}
+	return op;
+}
+
+static void render_pass_add_texture(struct wlr_render_pass *wlr_pass,
+		const struct wlr_render_texture_options *options) {
+	struct wlr_pixman_render_pass *pass = get_render_pass(wlr_pass);
+	struct wlr_pixman_texture *texture = get_texture(options->texture);
+	struct wlr_pixman_buffer *buffer = pass->buffer;
+
+	if (buffer->renderer->workers != NULL) {
+		struct wlr_pixman_render_op *op =
+			record_op(pass, WLR_PIXMAN_RENDER_OP_TEXTURE, options->clip);
+		if (op != NULL) {
+			op->texture = *options;
+			op->alpha = wlr_render_texture_options_get_alpha(options);
+		}
+		return;
+	}
+
+	if (texture->buffer != NULL && !begin_pixman_data_ptr_access(texture->buffer,
+			&texture->image, WLR_BUFFER_DATA_PTR_ACCESS_READ)) {
+		return;
+	}
+
+	composite_texture(buffer->image, buffer->buffer->width,
+		buffer->buffer->height, 0, texture->image, options);
+
+	if (texture->buffer != NULL) {
+		wlr_buffer_end_data_ptr_access(texture->buffer);
+	}
+}
+
+static void render_pass_add_rect(struct wlr_render_pass *wlr_pass,
+		const struct wlr_render_rect_options *options) {
+	struct wlr_pixman_render_pass *pass = get_render_pass(wlr_pass);
+	struct wlr_pixman_buffer *buffer = pass->buffer;
+
+	if (buffer->renderer->workers != NULL) {
+		struct wlr_pixman_render_op *op =
+			record_op(pass, WLR_PIXMAN_RENDER_OP_RECT, options->clip);
+		if (op != NULL) {
+			op->rect = *options;
+		}
+		return;
+	}
+
+	composite_rect(buffer->image, 0, options);
+}
+
 static const struct wlr_render_pass_impl render_pass_impl = {
 	.submit = render_pass_submit,
 	.add_texture = render_pass_add_texture,
@@ -185,6 +417,7 @@ struct wlr_pixman_render_pass *begin_pixman_render_pass(
 	}
 
 	wlr_render_pass_init(&pass->base, &render_pass_impl);
+	wl_array_init(&pass->ops);
 
 	if (!begin_pixman_data_ptr_access(buffer->buffer, &buffer->image,
 			WLR_BUFFER_DATA_PTR_ACCESS_READ | WLR_BUFFER_DATA_PTR_ACCESS_WRITE)) {
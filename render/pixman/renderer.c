@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <drm_fourcc.h>
+#include <errno.h>
 #include <pixman.h>
 #include <stdlib.h>
 #include <wayland-server.h>
@@ -10,6 +11,7 @@
 
 #include "render/pixman.h"
 #include "types/wlr_buffer.h"
+#include "util/env.h"
 
 static const struct wlr_renderer_impl renderer_impl;
 
@@ -88,7 +90,66 @@ static void texture_destroy(struct wlr_texture *wlr_texture) {
 	free(texture);
 }
 
+static void copy_buffer_rect(struct wlr_pixman_texture *texture,
+		const void *src, size_t src_stride, const pixman_box32_t *box) {
+	const struct wlr_pixel_format_info *info = texture->format_info;
+	// Packed formats only: one block per pixel
+	size_t bytes_per_pixel = info->bytes_per_block;
+	size_t dst_stride = pixman_image_get_stride(texture->image);
+
+	size_t x_offset = box->x1 * bytes_per_pixel;
+	size_t width = (box->x2 - box->x1) * bytes_per_pixel;
+	for (int32_t y = box->y1; y < box->y2; y++) {
+		memcpy((char *)texture->data + y * dst_stride + x_offset,
+			(const char *)src + y * src_stride + x_offset, width);
+	}
+}
+
+static bool texture_update_from_buffer(struct wlr_texture *wlr_texture,
+		struct wlr_buffer *buffer, const pixman_region32_t *damage) {
+	struct wlr_pixman_texture *texture = get_texture(wlr_texture);
+
+	// Textures backed by a client buffer can't be updated in-place
+	if (texture->data == NULL) {
+		return false;
+	}
+	if (buffer->width != (int)wlr_texture->width ||
+			buffer->height != (int)wlr_texture->height) {
+		return false;
+	}
+
+	void *data = NULL;
+	uint32_t drm_format;
+	size_t stride;
+	if (!wlr_buffer_begin_data_ptr_access(buffer, WLR_BUFFER_DATA_PTR_ACCESS_READ,
+			&data, &drm_format, &stride)) {
+		return false;
+	}
+
+	if (drm_format != texture->format_info->drm_format) {
+		wlr_buffer_end_data_ptr_access(buffer);
+		return false;
+	}
+
+	pixman_region32_t clipped;
+	pixman_region32_init(&clipped);
+	pixman_region32_intersect_rect(&clipped, damage,
+		0, 0, buffer->width, buffer->height);
+
+	int rects_len = 0;
+	const pixman_box32_t *rects = pixman_region32_rectangles(&clipped, &rects_len);
+	for (int i = 0; i < rects_len; i++) {
+		copy_buffer_rect(texture, data, stride, &rects[i]);
+	}
+
+	pixman_region32_fini(&clipped);
+	wlr_buffer_end_data_ptr_access(buffer);
+
+	return true;
+}
+
 static const struct wlr_texture_impl texture_impl = {
+	.update_from_buffer = texture_update_from_buffer,
 	.destroy = texture_destroy,
 };
 
@@ -372,6 +433,51 @@ static struct wlr_pixman_texture *pixman_texture_create(
 	return texture;
 }
 
+/**
+ * Back the texture with a private copy of the buffer contents, so that the
+ * buffer doesn't need to be kept locked. Later updates only copy the damaged
+ * regions.
+ */
+static struct wlr_texture *pixman_texture_init_shadow(
+		struct wlr_pixman_texture *texture, struct wlr_buffer *buffer) {
+	int32_t stride = pixel_format_info_min_stride(texture->format_info,
+		buffer->width);
+	// pixman requires strides to be a multiple of 4 bytes
+	stride = (stride + 3) & ~3;
+
+	texture->data = malloc((size_t)stride * buffer->height);
+	if (texture->data == NULL) {
+		wlr_log_errno(WLR_ERROR, "Failed to allocate shadow texture");
+		goto error_texture;
+	}
+
+	texture->image = pixman_image_create_bits_no_clear(texture->format,
+		buffer->width, buffer->height, texture->data, stride);
+	if (!texture->image) {
+		wlr_log(WLR_ERROR, "Failed to create pixman image");
+		goto error_data;
+	}
+
+	pixman_region32_t damage;
+	pixman_region32_init_rect(&damage, 0, 0, buffer->width, buffer->height);
+	bool ok = texture_update_from_buffer(&texture->wlr_texture, buffer, &damage);
+	pixman_region32_fini(&damage);
+	if (!ok) {
+		goto error_image;
+	}
+
+	return &texture->wlr_texture;
+
+error_image:
+	pixman_image_unref(texture->image);
+error_data:
+	free(texture->data);
+error_texture:
+	wl_list_remove(&texture->link);
+	free(texture);
+	return NULL;
+}
+
 static struct wlr_texture *pixman_texture_from_buffer(
 		struct wlr_renderer *wlr_renderer, struct wlr_buffer *buffer) {
 	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
@@ -391,6 +497,11 @@ static struct wlr_texture *pixman_texture_from_buffer(
 		return NULL;
 	}
 
+	if (renderer->shadow_textures &&
+			pixel_format_info_pixels_per_block(texture->format_info) == 1) {
+		return pixman_texture_init_shadow(texture, buffer);
+	}
+
 	texture->image = pixman_image_create_bits_no_clear(texture->format,
 		buffer->width, buffer->height, data, stride);
 	if (!texture->image) {
@@ -446,6 +557,7 @@ static void pixman_destroy(struct wlr_renderer *wlr_renderer) {
 	}
 
 	wlr_drm_format_set_finish(&renderer->drm_formats);
+	pixman_worker_pool_destroy(renderer->workers);
 
 	free(renderer);
 }
@@ -530,6 +642,22 @@ static const struct wlr_renderer_impl renderer_impl = {
 	.begin_buffer_pass = pixman_begin_buffer_pass,
 };
 
+static long get_env_threads(void) {
+	const char *str = getenv("WLR_PIXMAN_THREADS");
+	if (str == NULL) {
+		return 1;
+	}
+
+	char *end;
+	errno = 0;
+	long threads = strtol(str, &end, 10);
+	if (errno != 0 || *end != '\0' || threads < 1 || threads > 64) {
+		wlr_log(WLR_ERROR, "Invalid WLR_PIXMAN_THREADS value: %s", str);
+		return 1;
+	}
+	return threads;
+}
+
 struct wlr_renderer *wlr_pixman_renderer_create(void) {
 	struct wlr_pixman_renderer *renderer =
 		calloc(1, sizeof(struct wlr_pixman_renderer));
@@ -552,6 +680,18 @@ struct wlr_renderer *wlr_pixman_renderer_create(void) {
 			DRM_FORMAT_MOD_LINEAR);
 	}
 
+	renderer->shadow_textures = env_parse_bool("WLR_PIXMAN_SHADOW_TEXTURES");
+
+	// The calling thread takes part in rendering as well
+	long threads = get_env_threads();
+	if (threads > 1) {
+		renderer->workers = pixman_worker_pool_create(threads - 1);
+		if (renderer->workers == NULL) {
+			wlr_log(WLR_ERROR, "Failed to create worker pool, "
+				"falling back to single-threaded rendering");
+		}
+	}
+
 	return &renderer->wlr_renderer;
 }
 
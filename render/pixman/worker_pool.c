@@ -0,0 +1,152 @@
+#include <assert.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <wlr/util/log.h>
+#include "render/pixman.h"
+
+struct wlr_pixman_worker_pool {
+	pthread_t *threads;
+	size_t threads_len;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t job_cond; // a job has been queued, or the pool is stopping
+	pthread_cond_t done_cond; // all items of the current job are done
+
+	pixman_worker_func_t job_func;
+	void *job_data;
+	size_t job_len, job_next, job_done;
+	bool stop;
+};
+
+// Must be called with the pool mutex held
+static void pool_run_item(struct wlr_pixman_worker_pool *pool) {
+	pixman_worker_func_t func = pool->job_func;
+	void *data = pool->job_data;
+	size_t index = pool->job_next++;
+
+	pthread_mutex_unlock(&pool->mutex);
+	func(data, index);
+	pthread_mutex_lock(&pool->mutex);
+
+	pool->job_done++;
+	if (pool->job_done == pool->job_len) {
+		pthread_cond_signal(&pool->done_cond);
+	}
+}
+
+static void *worker_run(void *data) {
+	struct wlr_pixman_worker_pool *pool = data;
+
+	pthread_mutex_lock(&pool->mutex);
+	while (true) {
+		while (!pool->stop && pool->job_next >= pool->job_len) {
+			pthread_cond_wait(&pool->job_cond, &pool->mutex);
+		}
+		if (pool->stop) {
+			break;
+		}
+
+		pool_run_item(pool);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	return NULL;
+}
+
+struct wlr_pixman_worker_pool *pixman_worker_pool_create(size_t threads_len) {
+	assert(threads_len > 0);
+
+	struct wlr_pixman_worker_pool *pool = calloc(1, sizeof(*pool));
+	if (pool == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+
+	pool->threads = calloc(threads_len, sizeof(pool->threads[0]));
+	if (pool->threads == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		free(pool);
+		return NULL;
+	}
+
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->job_cond, NULL);
+	pthread_cond_init(&pool->done_cond, NULL);
+
+	// Signals are dispatched via the event loop on the main thread, make
+	// sure they never get delivered to a worker
+	sigset_t mask, old_mask;
+	sigfillset(&mask);
+	pthread_sigmask(SIG_BLOCK, &mask, &old_mask);
+
+	for (size_t i = 0; i < threads_len; i++) {
+		int ret = pthread_create(&pool->threads[i], NULL, worker_run, pool);
+		if (ret != 0) {
+			wlr_log(WLR_ERROR, "Failed to create worker thread (error %d)", ret);
+			break;
+		}
+		pool->threads_len++;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+	if (pool->threads_len == 0) {
+		pixman_worker_pool_destroy(pool);
+		return NULL;
+	}
+
+	wlr_log(WLR_DEBUG, "Started %zu pixman worker threads", pool->threads_len);
+	return pool;
+}
+
+void pixman_worker_pool_destroy(struct wlr_pixman_worker_pool *pool) {
+	if (pool == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->stop = true;
+	pthread_cond_broadcast(&pool->job_cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (size_t i = 0; i < pool->threads_len; i++) {
+		pthread_join(pool->threads[i], NULL);
+	}
+
+	pthread_cond_destroy(&pool->done_cond);
+	pthread_cond_destroy(&pool->job_cond);
+	pthread_mutex_destroy(&pool->mutex);
+	free(pool->threads);
+	free(pool);
+}
+
+size_t pixman_worker_pool_get_threads_len(struct wlr_pixman_worker_pool *pool) {
+	return pool->threads_len;
+}
+
+void pixman_worker_pool_run(struct wlr_pixman_worker_pool *pool,
+		pixman_worker_func_t func, void *data, size_t len) {
+	pthread_mutex_lock(&pool->mutex);
+	assert(pool->job_len == 0);
+
+	pool->job_func = func;
+	pool->job_data = data;
+	pool->job_len = len;
+	pool->job_next = 0;
+	pool->job_done = 0;
+	pthread_cond_broadcast(&pool->job_cond);
+
+	// The calling thread processes items too instead of idling
+	while (pool->job_next < pool->job_len) {
+		pool_run_item(pool);
+	}
+	while (pool->job_done < pool->job_len) {
+		pthread_cond_wait(&pool->done_cond, &pool->mutex);
+	}
+
+	pool->job_func = NULL;
+	pool->job_data = NULL;
+	pool->job_len = pool->job_next = pool->job_done = 0;
+	pthread_mutex_unlock(&pool->mutex);
+}
@@ -0,0 +1,272 @@
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <wlr/render/interface.h>
+#include <wlr/render/recording.h>
+#include <wlr/render/wlr_texture.h>
+#include <wlr/util/log.h>
+
+struct wlr_render_recording_pass {
+	struct wlr_render_pass base;
+	struct wlr_render_recording *recording;
+	struct wlr_render_pass *target; // may be NULL
+	struct wl_listener recording_destroy;
+};
+
+static const struct wlr_render_pass_impl recording_pass_impl;
+
+static struct wlr_render_recording_pass *get_recording_pass(
+		struct wlr_render_pass *wlr_pass) {
+	assert(wlr_pass->impl == &recording_pass_impl);
+	struct wlr_render_recording_pass *pass = wl_container_of(wlr_pass, pass, base);
+	return pass;
+}
+
+struct wlr_render_recording *wlr_render_recording_create(void) {
+	struct wlr_render_recording *recording = calloc(1, sizeof(*recording));
+	if (recording == NULL) {
+		return NULL;
+	}
+	wl_array_init(&recording->ops);
+	wl_signal_init(&recording->events.destroy);
+	return recording;
+}
+
+void wlr_render_recording_reset(struct wlr_render_recording *recording) {
+	struct wlr_render_recording_op *op;
+	wl_array_for_each(op, &recording->ops) {
+		pixman_region32_fini(&op->clip);
+	}
+	recording->ops.size = 0;
+}
+
+void wlr_render_recording_destroy(struct wlr_render_recording *recording) {
+	if (recording == NULL) {
+		return;
+	}
+
+	wl_signal_emit_mutable(&recording->events.destroy, NULL);
+
+	wlr_render_recording_reset(recording);
+	wl_array_release(&recording->ops);
+	free(recording);
+}
+
+static struct wlr_render_recording_op *add_op(struct wlr_render_recording *recording,
+		enum wlr_render_recording_op_type type, const pixman_region32_t *clip) {
+	struct wlr_render_recording_op *op = wl_array_add(&recording->ops, sizeof(*op));
+	if (op == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+
+	*op = (struct wlr_render_recording_op){ .type = type };
+	if (clip != NULL) {
+		pixman_region32_init(&op->clip);
+		pixman_region32_copy(&op->clip, clip);
+	} else {
+		pixman_region32_init_rect(&op->clip, 0, 0,
+			recording->width, recording->height);
+	}
+	return op;
+}
+
+static bool recording_pass_submit(struct wlr_render_pass *wlr_pass) {
+	struct wlr_render_recording_pass *pass = get_recording_pass(wlr_pass);
+	bool ok = true;
+	if (pass->target != NULL) {
+		ok = wlr_render_pass_submit(pass->target);
+	}
+	wl_list_remove(&pass->recording_destroy.link);
+	free(pass);
+	return ok;
+}
+
+static void recording_pass_add_texture(struct wlr_render_pass *wlr_pass,
+		const struct wlr_render_texture_options *options) {
+	struct wlr_render_recording_pass *pass = get_recording_pass(wlr_pass);
+	if (pass->target != NULL) {
+		wlr_render_pass_add_texture(pass->target, options);
+	}
+	if (pass->recording == NULL) {
+		return;
+	}
+
+	struct wlr_render_recording_op *op = add_op(pass->recording,
+		WLR_RENDER_RECORDING_OP_TEXTURE, options->clip);
+	if (op == NULL) {
+		return;
+	}
+
+	op->texture.texture = options->texture;
+	op->texture.width = options->texture->width;
+	op->texture.height = options->texture->height;
+	wlr_render_texture_options_get_src_box(options, &op->texture.src_box);
+	wlr_render_texture_options_get_dst_box(options, &op->texture.dst_box);
+	op->texture.alpha = wlr_render_texture_options_get_alpha(options);
+	op->texture.transform = options->transform;
+}
+
+static void recording_pass_add_rect(struct wlr_render_pass *wlr_pass,
+		const struct wlr_render_rect_options *options) {
+	struct wlr_render_recording_pass *pass = get_recording_pass(wlr_pass);
+	if (pass->target != NULL) {
+		wlr_render_pass_add_rect(pass->target, options);
+	}
+	if (pass->recording == NULL) {
+		return;
+	}
+
+	struct wlr_render_recording_op *op = add_op(pass->recording,
+		WLR_RENDER_RECORDING_OP_RECT, options->clip);
+	if (op == NULL) {
+		return;
+	}
+
+	op->rect.box = options->box;
+	op->rect.color = options->color;
+	op->rect.blend_mode = options->blend_mode;
+}
+
+static const struct wlr_render_pass_impl recording_pass_impl = {
+	.submit = recording_pass_submit,
+	.add_texture = recording_pass_add_texture,
+	.add_rect = recording_pass_add_rect,
+};
+
+static void recording_pass_handle_recording_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_render_recording_pass *pass =
+		wl_container_of(listener, pass, recording_destroy);
+	// Keep forwarding to the target until the pass is submitted
+	wl_list_remove(&pass->recording_destroy.link);
+	wl_list_init(&pass->recording_destroy.link);
+	pass->recording = NULL;
+}
+
+struct wlr_render_pass *wlr_render_recording_begin_pass(
+		struct wlr_render_recording *recording, struct wlr_render_pass *target,
+		int width, int height) {
+	struct wlr_render_recording_pass *pass = calloc(1, sizeof(*pass));
+	if (pass == NULL) {
+		return NULL;
+	}
+
+	wlr_render_pass_init(&pass->base, &recording_pass_impl);
+	pass->recording = recording;
+	pass->target = target;
+
+	pass->recording_destroy.notify = recording_pass_handle_recording_destroy;
+	wl_signal_add(&recording->events.destroy, &pass->recording_destroy);
+
+	wlr_render_recording_reset(recording);
+	recording->width = width;
+	recording->height = height;
+
+	return &pass->base;
+}
+
+void wlr_render_recording_replay(struct wlr_render_recording *recording,
+		struct wlr_render_pass *render_pass) {
+	struct wlr_render_recording_op *op;
+	wl_array_for_each(op, &recording->ops) {
+		switch (op->type) {
+		case WLR_RENDER_RECORDING_OP_TEXTURE:
+			wlr_render_pass_add_texture(render_pass, &(struct wlr_render_texture_options){
+				.texture = op->texture.texture,
+				.src_box = op->texture.src_box,
+				.dst_box = op->texture.dst_box,
+				.alpha = &op->texture.alpha,
+				.clip = &op->clip,
+				.transform = op->texture.transform,
+			});
+			break;
+		case WLR_RENDER_RECORDING_OP_RECT:
+			wlr_render_pass_add_rect(render_pass, &(struct wlr_render_rect_options){
+				.box = op->rect.box,
+				.color = op->rect.color,
+				.clip = &op->clip,
+				.blend_mode = op->rect.blend_mode,
+			});
+			break;
+		}
+	}
+}
+
+static const char *blend_mode_str(enum wlr_render_blend_mode mode) {
+	switch (mode) {
+	case WLR_RENDER_BLEND_MODE_PREMULTIPLIED:
+		return "premultiplied";
+	case WLR_RENDER_BLEND_MODE_NONE:
+		return "none";
+	}
+	return "unknown";
+}
+
+static size_t get_texture_id(struct wl_array *textures,
+		struct wlr_texture *texture) {
+	size_t id = 0;
+	struct wlr_texture **ptr;
+	wl_array_for_each(ptr, textures) {
+		if (*ptr == texture) {
+			return id;
+		}
+		id++;
+	}
+
+	ptr = wl_array_add(textures, sizeof(*ptr));
+	if (ptr != NULL) {
+		*ptr = texture;
+	}
+	return id;
+}
+
+static void write_clip(FILE *f, const pixman_region32_t *clip) {
+	int rects_len = 0;
+	const pixman_box32_t *rects = pixman_region32_rectangles(clip, &rects_len);
+	fprintf(f, " clip %d", rects_len);
+	for (int i = 0; i < rects_len; i++) {
+		fprintf(f, " %d,%d,%d,%d", rects[i].x1, rects[i].y1,
+			rects[i].x2, rects[i].y2);
+	}
+}
+
+bool wlr_render_recording_write(struct wlr_render_recording *recording,
+		FILE *f) {
+	size_t ops_len = recording->ops.size / sizeof(struct wlr_render_recording_op);
+	fprintf(f, "pass %dx%d ops %zu\n", recording->width, recording->height, ops_len);
+
+	struct wl_array textures; // struct wlr_texture *
+	wl_array_init(&textures);
+
+	struct wlr_render_recording_op *op;
+	wl_array_for_each(op, &recording->ops) {
+		switch (op->type) {
+		case WLR_RENDER_RECORDING_OP_TEXTURE:;
+			const struct wlr_fbox *src = &op->texture.src_box;
+			const struct wlr_box *dst = &op->texture.dst_box;
+			fprintf(f, "texture %zu %"PRIu32"x%"PRIu32" "
+				"src %g,%g,%gx%g dst %d,%d,%dx%d alpha %g transform %d",
+				get_texture_id(&textures, op->texture.texture),
+				op->texture.width, op->texture.height,
+				src->x, src->y, src->width, src->height,
+				dst->x, dst->y, dst->width, dst->height,
+				op->texture.alpha, (int)op->texture.transform);
+			break;
+		case WLR_RENDER_RECORDING_OP_RECT:;
+			const struct wlr_box *box = &op->rect.box;
+			const struct wlr_render_color *color = &op->rect.color;
+			fprintf(f, "rect %d,%d,%dx%d color %g,%g,%g,%g blend %s",
+				box->x, box->y, box->width, box->height,
+				color->r, color->g, color->b, color->a,
+				blend_mode_str(op->rect.blend_mode));
+			break;
+		}
+		write_clip(f, &op->clip);
+		fprintf(f, "\n");
+	}
+
+	wl_array_release(&textures);
+
+	return !ferror(f);
+}
@@ -18,6 +18,19 @@ static void swapchain_handle_allocator_destroy(struct wl_listener *listener,
 struct wlr_swapchain *wlr_swapchain_create(
 		struct wlr_allocator *alloc, int width, int height,
 		const struct wlr_drm_format *format) {
+	return wlr_swapchain_create_with_len(alloc, width, height, format,
+		WLR_SWAPCHAIN_CAP);
+}
+
+struct wlr_swapchain *wlr_swapchain_create_with_len(
+		struct wlr_allocator *alloc, int width, int height,
+		const struct wlr_drm_format *format, size_t len) {
+	if (len == 0 || len > WLR_SWAPCHAIN_CAP) {
+		wlr_log(WLR_ERROR, "Invalid swapchain length %zu (must be between 1 and %d)",
+			len, WLR_SWAPCHAIN_CAP);
+		return NULL;
+	}
+
 	struct wlr_swapchain *swapchain = calloc(1, sizeof(*swapchain));
 	if (swapchain == NULL) {
 		return NULL;
@@ -25,6 +38,7 @@ struct wlr_swapchain *wlr_swapchain_create(
 	swapchain->allocator = alloc;
 	swapchain->width = width;
 	swapchain->height = height;
+	swapchain->len = len;
 
 	if (!wlr_drm_format_copy(&swapchain->format, format)) {
 		free(swapchain);
@@ -49,7 +63,7 @@ void wlr_swapchain_destroy(struct wlr_swapchain *swapchain) {
 	if (swapchain == NULL) {
 		return;
 	}
-	for (size_t i = 0; i < WLR_SWAPCHAIN_CAP; i++) {
+	for (size_t i = 0; i < swapchain->len; i++) {
 		slot_reset(&swapchain->slots[i]);
 	}
 	wl_list_remove(&swapchain->allocator_destroy.link);
@@ -83,18 +97,30 @@ static struct wlr_buffer *slot_acquire(struct wlr_swapchain *swapchain,
 
 struct wlr_buffer *wlr_swapchain_acquire(struct wlr_swapchain *swapchain,
 		int *age) {
-	struct wlr_swapchain_slot *free_slot = NULL;
-	for (size_t i = 0; i < WLR_SWAPCHAIN_CAP; i++) {
+	// Prefer the youngest released buffer, since it needs the least damage
+	// to be repainted. Buffers which have never been submitted have an
+	// unknown age and are only used if no other buffer is available.
+	struct wlr_swapchain_slot *best_slot = NULL, *free_slot = NULL;
+	for (size_t i = 0; i < swapchain->len; i++) {
 		struct wlr_swapchain_slot *slot = &swapchain->slots[i];
 		if (slot->acquired) {
 			continue;
 		}
-		if (slot->buffer != NULL) {
-			return slot_acquire(swapchain, slot, age);
+		if (slot->buffer == NULL) {
+			free_slot = slot;
+			continue;
+		}
+		if (best_slot == NULL || (slot->age > 0 &&
+				(best_slot->age == 0 || slot->age < best_slot->age))) {
+			best_slot = slot;
 		}
-		free_slot = slot;
+	}
+	if (best_slot != NULL) {
+		swapchain->stats.acquired++;
+		return slot_acquire(swapchain, best_slot, age);
 	}
 	if (free_slot == NULL) {
+		swapchain->stats.starved++;
 		wlr_log(WLR_ERROR, "No free output buffer slot");
 		return NULL;
 	}
@@ -110,12 +136,36 @@ struct wlr_buffer *wlr_swapchain_acquire(struct wlr_swapchain *swapchain,
 		wlr_log(WLR_ERROR, "Failed to allocate buffer");
 		return NULL;
 	}
+	swapchain->stats.allocated++;
+	swapchain->stats.acquired++;
 	return slot_acquire(swapchain, free_slot, age);
 }
 
+bool wlr_swapchain_prealloc(struct wlr_swapchain *swapchain) {
+	for (size_t i = 0; i < swapchain->len; i++) {
+		struct wlr_swapchain_slot *slot = &swapchain->slots[i];
+		if (slot->buffer != NULL) {
+			continue;
+		}
+
+		if (swapchain->allocator == NULL) {
+			return false;
+		}
+
+		slot->buffer = wlr_allocator_create_buffer(swapchain->allocator,
+			swapchain->width, swapchain->height, &swapchain->format);
+		if (slot->buffer == NULL) {
+			wlr_log(WLR_ERROR, "Failed to allocate buffer");
+			return false;
+		}
+		swapchain->stats.allocated++;
+	}
+	return true;
+}
+
 static bool swapchain_has_buffer(struct wlr_swapchain *swapchain,
 		struct wlr_buffer *buffer) {
-	for (size_t i = 0; i < WLR_SWAPCHAIN_CAP; i++) {
+	for (size_t i = 0; i < swapchain->len; i++) {
 		struct wlr_swapchain_slot *slot = &swapchain->slots[i];
 		if (slot->buffer == buffer) {
 			return true;
@@ -134,7 +184,7 @@ void wlr_swapchain_set_buffer_submitted(struct wlr_swapchain *swapchain,
 
 	// See the algorithm described in:
 	// https://www.khronos.org/registry/EGL/extensions/EXT/EGL_EXT_buffer_age.txt
-	for (size_t i = 0; i < WLR_SWAPCHAIN_CAP; i++) {
+	for (size_t i = 0; i < swapchain->len; i++) {
 		struct wlr_swapchain_slot *slot = &swapchain->slots[i];
 		if (slot->buffer == buffer) {
 			slot->age = 1;
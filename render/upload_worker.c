@@ -0,0 +1,190 @@
+#include <assert.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/util/log.h>
+#include "render/upload_worker.h"
+#include "util/env.h"
+
+struct wlr_upload_worker {
+	pthread_t thread;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t queue_cond; // a job has been queued, or the worker is stopping
+	pthread_cond_t done_cond; // a job is done
+
+	struct wl_list queue; // wlr_upload_job.link
+	bool stop;
+};
+
+static void copy_region(struct wlr_upload_job *job) {
+	size_t stride = job->stride;
+	char *dst = job->dst;
+	int rects_len = 0;
+	const pixman_box32_t *rects = pixman_region32_rectangles(&job->region, &rects_len);
+	for (int i = 0; i < rects_len; i++) {
+		const pixman_box32_t *rect = &rects[i];
+		size_t packed_stride = (size_t)(rect->x2 - rect->x1) * job->bytes_per_pixel;
+		const char *src = (const char *)job->data + (size_t)rect->y1 * stride +
+			(size_t)rect->x1 * job->bytes_per_pixel;
+		if (packed_stride == stride) {
+			size_t size = packed_stride * (rect->y2 - rect->y1);
+			memcpy(dst, src, size);
+			dst += size;
+			continue;
+		}
+		for (int32_t y = rect->y1; y < rect->y2; y++) {
+			memcpy(dst, src, packed_stride);
+			src += stride;
+			dst += packed_stride;
+		}
+	}
+}
+
+static void *worker_run(void *data) {
+	struct wlr_upload_worker *worker = data;
+
+	pthread_mutex_lock(&worker->mutex);
+	while (true) {
+		while (!worker->stop && wl_list_empty(&worker->queue)) {
+			pthread_cond_wait(&worker->queue_cond, &worker->mutex);
+		}
+		if (wl_list_empty(&worker->queue)) {
+			break; // stopping
+		}
+
+		struct wlr_upload_job *job =
+			wl_container_of(worker->queue.next, job, link);
+		wl_list_remove(&job->link);
+		wl_list_init(&job->link);
+
+		pthread_mutex_unlock(&worker->mutex);
+		copy_region(job);
+		pthread_mutex_lock(&worker->mutex);
+
+		job->done = true;
+		pthread_cond_broadcast(&worker->done_cond);
+	}
+	pthread_mutex_unlock(&worker->mutex);
+
+	return NULL;
+}
+
+struct wlr_upload_worker *upload_worker_create(void) {
+	if (!env_parse_bool("WLR_RENDER_ASYNC_UPLOAD")) {
+		return NULL;
+	}
+
+	struct wlr_upload_worker *worker = calloc(1, sizeof(*worker));
+	if (worker == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+
+	pthread_mutex_init(&worker->mutex, NULL);
+	pthread_cond_init(&worker->queue_cond, NULL);
+	pthread_cond_init(&worker->done_cond, NULL);
+	wl_list_init(&worker->queue);
+
+	// Signals are dispatched via the event loop on the main thread. SIGBUS
+	// is left unblocked: reading a client's shm buffer can raise it on this
+	// thread, and the handler installed by the main thread when it began
+	// accessing the buffer replaces the truncated pages.
+	sigset_t mask, old_mask;
+	sigfillset(&mask);
+	sigdelset(&mask, SIGBUS);
+	sigdelset(&mask, SIGSEGV);
+	pthread_sigmask(SIG_BLOCK, &mask, &old_mask);
+	int ret = pthread_create(&worker->thread, NULL, worker_run, worker);
+	pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+	if (ret != 0) {
+		wlr_log(WLR_ERROR, "Failed to create upload thread (error %d)", ret);
+		pthread_cond_destroy(&worker->done_cond);
+		pthread_cond_destroy(&worker->queue_cond);
+		pthread_mutex_destroy(&worker->mutex);
+		free(worker);
+		return NULL;
+	}
+
+	wlr_log(WLR_DEBUG, "Started texture upload thread");
+	return worker;
+}
+
+void upload_worker_destroy(struct wlr_upload_worker *worker) {
+	if (worker == NULL) {
+		return;
+	}
+
+	// Queued jobs are still processed before the thread exits
+	pthread_mutex_lock(&worker->mutex);
+	worker->stop = true;
+	pthread_cond_broadcast(&worker->queue_cond);
+	pthread_mutex_unlock(&worker->mutex);
+
+	pthread_join(worker->thread, NULL);
+
+	pthread_cond_destroy(&worker->done_cond);
+	pthread_cond_destroy(&worker->queue_cond);
+	pthread_mutex_destroy(&worker->mutex);
+	free(worker);
+}
+
+size_t upload_region_size(const pixman_region32_t *region,
+		size_t bytes_per_pixel) {
+	size_t size = 0;
+	int rects_len = 0;
+	const pixman_box32_t *rects = pixman_region32_rectangles(region, &rects_len);
+	for (int i = 0; i < rects_len; i++) {
+		size += (size_t)(rects[i].x2 - rects[i].x1) *
+			(rects[i].y2 - rects[i].y1) * bytes_per_pixel;
+	}
+	return size;
+}
+
+struct wlr_upload_job *upload_worker_submit(struct wlr_upload_worker *worker,
+		struct wlr_buffer *buffer, const void *data, size_t stride,
+		const pixman_region32_t *region, size_t bytes_per_pixel, void *dst) {
+	struct wlr_upload_job *job = calloc(1, sizeof(*job));
+	if (job == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+
+	job->buffer = wlr_buffer_lock(buffer);
+	job->data = data;
+	job->stride = stride;
+	pixman_region32_init(&job->region);
+	pixman_region32_copy(&job->region, region);
+	job->bytes_per_pixel = bytes_per_pixel;
+	job->dst = dst;
+
+	pthread_mutex_lock(&worker->mutex);
+	wl_list_insert(worker->queue.prev, &job->link);
+	pthread_cond_signal(&worker->queue_cond);
+	pthread_mutex_unlock(&worker->mutex);
+
+	return job;
+}
+
+void upload_job_wait(struct wlr_upload_worker *worker,
+		struct wlr_upload_job *job) {
+	pthread_mutex_lock(&worker->mutex);
+	while (!job->done) {
+		pthread_cond_wait(&worker->done_cond, &worker->mutex);
+	}
+	pthread_mutex_unlock(&worker->mutex);
+}
+
+void upload_job_finish(struct wlr_upload_worker *worker,
+		struct wlr_upload_job *job) {
+	upload_job_wait(worker, job);
+	// Buffers are only accessed, locked and unlocked on the main thread
+	wlr_buffer_end_data_ptr_access(job->buffer);
+	wlr_buffer_unlock(job->buffer);
+	pixman_region32_fini(&job->region);
+	free(job);
+}
+
@@ -0,0 +1,376 @@
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vulkan/vulkan.h>
+#include <wlr/types/wlr_matrix.h>
+#include <wlr/util/log.h>
+#include "render/vulkan.h"
+
+enum wlr_vk_render_op_type {
+	WLR_VK_RENDER_OP_DRAW,
+	WLR_VK_RENDER_OP_CLEAR,
+};
+
+struct wlr_vk_render_op {
+	enum wlr_vk_render_op_type type;
+
+	// Only used for draws
+	VkPipeline pipe;
+	VkPipelineLayout pipe_layout;
+	VkDescriptorSet ds; // VK_NULL_HANDLE for rects
+	struct wlr_vk_vert_pcr_data vert_pcr_data;
+	float frag_pcr_data[4]; // linear color, or alpha for textures
+	uint32_t frag_pcr_size;
+
+	// Range in wlr_vk_render_pass.rects. For textures, rects are mapped onto
+	// the unit quad of vert_pcr_data, otherwise they are in buffer-local
+	// coordinates.
+	uint32_t first_rect;
+	uint32_t rects_len;
+};
+
+static const struct wlr_render_pass_impl render_pass_impl;
+
+static struct wlr_vk_render_pass *get_render_pass(struct wlr_render_pass *wlr_pass) {
+	assert(wlr_pass->impl == &render_pass_impl);
+	struct wlr_vk_render_pass *pass = wl_container_of(wlr_pass, pass, base);
+	return pass;
+}
+
+static void get_clip_region(struct wlr_vk_render_pass *pass,
+		const pixman_region32_t *in, pixman_region32_t *out) {
+	if (in != NULL) {
+		pixman_region32_init(out);
+		pixman_region32_copy(out, in);
+	} else {
+		pixman_region32_init_rect(out, 0, 0, pass->width, pass->height);
+	}
+}
+
+static bool op_state_equal(const struct wlr_vk_render_op *a,
+		const struct wlr_vk_render_op *b) {
+	return a->type == b->type && a->pipe == b->pipe && a->ds == b->ds &&
+		a->frag_pcr_size == b->frag_pcr_size &&
+		memcmp(&a->vert_pcr_data, &b->vert_pcr_data, sizeof(a->vert_pcr_data)) == 0 &&
+		memcmp(a->frag_pcr_data, b->frag_pcr_data, sizeof(a->frag_pcr_data)) == 0;
+}
+
+/**
+ * Get the op the next rects should be appended to. Consecutive ops with the
+ * same state are merged into a single instanced draw.
+ */
+static struct wlr_vk_render_op *get_op(struct wlr_vk_render_pass *pass,
+		const struct wlr_vk_render_op *state) {
+	if (pass->ops.size > 0) {
+		struct wlr_vk_render_op *last = (void *)((char *)pass->ops.data +
+			pass->ops.size - sizeof(*last));
+		if (op_state_equal(last, state)) {
+			return last;
+		}
+	}
+
+	struct wlr_vk_render_op *op = wl_array_add(&pass->ops, sizeof(*op));
+	if (op == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+	*op = *state;
+	op->first_rect = pass->rects.size / sizeof(float[4]);
+	op->rects_len = 0;
+	return op;
+}
+
+static bool add_rect(struct wlr_vk_render_pass *pass, struct wlr_vk_render_op *op,
+		float x1, float y1, float x2, float y2) {
+	float *rect = wl_array_add(&pass->rects, sizeof(float[4]));
+	if (rect == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return false;
+	}
+	rect[0] = x1;
+	rect[1] = y1;
+	rect[2] = x2;
+	rect[3] = y2;
+	op->rects_len++;
+	return true;
+}
+
+static void render_pass_add_texture(struct wlr_render_pass *wlr_pass,
+		const struct wlr_render_texture_options *options) {
+	struct wlr_vk_render_pass *pass = get_render_pass(wlr_pass);
+	struct wlr_vk_renderer *renderer = pass->renderer;
+	struct wlr_texture *wlr_texture = options->texture;
+	struct wlr_vk_texture *texture = vulkan_get_texture(wlr_texture);
+	assert(texture->renderer == renderer);
+
+	struct wlr_fbox src_box;
+	wlr_render_texture_options_get_src_box(options, &src_box);
+	struct wlr_box dst_box;
+	wlr_render_texture_options_get_dst_box(options, &dst_box);
+	float alpha = wlr_render_texture_options_get_alpha(options);
+
+	pixman_region32_t clip;
+	get_clip_region(pass, options->clip, &clip);
+	pixman_region32_intersect_rect(&clip, &clip,
+		dst_box.x, dst_box.y, dst_box.width, dst_box.height);
+
+	int rects_len = 0;
+	const pixman_box32_t *rects = pixman_region32_rectangles(&clip, &rects_len);
+	if (rects_len == 0) {
+		goto out;
+	}
+
+	float proj[9], matrix[9];
+	wlr_matrix_identity(proj);
+	wlr_matrix_project_box(matrix, &dst_box, options->transform, 0.0, proj);
+
+	// The inverse maps buffer-local clip rects onto the unit quad drawn by
+	// the vertex shader
+	float det = matrix[0] * matrix[4] - matrix[1] * matrix[3];
+	if (det == 0) {
+		goto out;
+	}
+	const float inv[4] = {
+		matrix[4] / det, -matrix[1] / det,
+		-matrix[3] / det, matrix[0] / det,
+	};
+
+	struct wlr_vk_render_op state = {
+		.type = WLR_VK_RENDER_OP_DRAW,
+		.pipe = vulkan_get_texture_pipeline(texture,
+			renderer->current_render_buffer->render_setup),
+		.pipe_layout = texture->pipeline_layout->vk,
+		.ds = texture->ds,
+		.frag_pcr_data = { alpha },
+		.frag_pcr_size = sizeof(float),
+	};
+
+	float final_matrix[9];
+	wlr_matrix_multiply(final_matrix, renderer->projection, matrix);
+	vulkan_mat3_to_mat4(final_matrix, state.vert_pcr_data.mat4);
+	state.vert_pcr_data.uv_off[0] = src_box.x / wlr_texture->width;
+	state.vert_pcr_data.uv_off[1] = src_box.y / wlr_texture->height;
+	state.vert_pcr_data.uv_size[0] = src_box.width / wlr_texture->width;
+	state.vert_pcr_data.uv_size[1] = src_box.height / wlr_texture->height;
+
+	struct wlr_vk_render_op *op = get_op(pass, &state);
+	if (op == NULL) {
+		goto out;
+	}
+
+	vulkan_use_texture(texture);
+
+	for (int i = 0; i < rects_len; i++) {
+		const pixman_box32_t *rect = &rects[i];
+		float u1 = inv[0] * (rect->x1 - matrix[2]) + inv[1] * (rect->y1 - matrix[5]);
+		float v1 = inv[2] * (rect->x1 - matrix[2]) + inv[3] * (rect->y1 - matrix[5]);
+		float u2 = inv[0] * (rect->x2 - matrix[2]) + inv[1] * (rect->y2 - matrix[5]);
+		float v2 = inv[2] * (rect->x2 - matrix[2]) + inv[3] * (rect->y2 - matrix[5]);
+		// Transforms are multiples of 90 degrees, so the rect stays
+		// axis-aligned on the unit quad
+		if (!add_rect(pass, op, fminf(u1, u2), fminf(v1, v2),
+				fmaxf(u1, u2), fmaxf(v1, v2))) {
+			break;
+		}
+	}
+
+out:
+	pixman_region32_fini(&clip);
+}
+
+static void render_pass_add_rect(struct wlr_render_pass *wlr_pass,
+		const struct wlr_render_rect_options *options) {
+	struct wlr_vk_render_pass *pass = get_render_pass(wlr_pass);
+	struct wlr_vk_renderer *renderer = pass->renderer;
+
+	pixman_region32_t clip;
+	get_clip_region(pass, options->clip, &clip);
+	pixman_region32_intersect_rect(&clip, &clip,
+		options->box.x, options->box.y, options->box.width, options->box.height);
+	// Clear rects must be within the render area
+	pixman_region32_intersect_rect(&clip, &clip, 0, 0, pass->width, pass->height);
+
+	int rects_len = 0;
+	const pixman_box32_t *rects = pixman_region32_rectangles(&clip, &rects_len);
+	if (rects_len == 0) {
+		goto out;
+	}
+
+	// Input color values are given in srgb space, shader expects
+	// them in linear space. See vulkan_render_quad_with_matrix().
+	struct wlr_vk_render_op state = {
+		.frag_pcr_data = {
+			vulkan_color_to_linear(options->color.r),
+			vulkan_color_to_linear(options->color.g),
+			vulkan_color_to_linear(options->color.b),
+			options->color.a, // no conversion for alpha
+		},
+	};
+
+	switch (options->blend_mode) {
+	case WLR_RENDER_BLEND_MODE_PREMULTIPLIED:
+		state.type = WLR_VK_RENDER_OP_DRAW;
+		state.pipe = renderer->current_render_buffer->render_setup->quad_pipe;
+		state.pipe_layout = renderer->default_pipeline_layout.vk;
+		state.frag_pcr_size = sizeof(float[4]);
+		// Rects are in buffer-local coordinates, so that all rects with the
+		// same color share the same push constants
+		vulkan_mat3_to_mat4(renderer->projection, state.vert_pcr_data.mat4);
+		state.vert_pcr_data.uv_size[0] = 1.f;
+		state.vert_pcr_data.uv_size[1] = 1.f;
+		break;
+	case WLR_RENDER_BLEND_MODE_NONE:
+		state.type = WLR_VK_RENDER_OP_CLEAR;
+		break;
+	}
+
+	struct wlr_vk_render_op *op = get_op(pass, &state);
+	if (op == NULL) {
+		goto out;
+	}
+
+	for (int i = 0; i < rects_len; i++) {
+		if (!add_rect(pass, op, rects[i].x1, rects[i].y1,
+				rects[i].x2, rects[i].y2)) {
+			break;
+		}
+	}
+
+out:
+	pixman_region32_fini(&clip);
+}
+
+static void render_op_clear(struct wlr_vk_render_pass *pass,
+		const struct wlr_vk_render_op *op) {
+	VkCommandBuffer cb = pass->renderer->current_command_buffer->vk;
+	const float (*rects)[4] = pass->rects.data;
+
+	VkClearRect *clear_rects = calloc(op->rects_len, sizeof(*clear_rects));
+	if (clear_rects == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return;
+	}
+
+	for (uint32_t i = 0; i < op->rects_len; i++) {
+		const float *rect = rects[op->first_rect + i];
+		clear_rects[i] = (VkClearRect){
+			.rect = {
+				.offset = { rect[0], rect[1] },
+				.extent = { rect[2] - rect[0], rect[3] - rect[1] },
+			},
+			.layerCount = 1,
+		};
+	}
+
+	VkClearAttachment att = {
+		.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+		.colorAttachment = 0u,
+		.clearValue.color.float32 = {
+			op->frag_pcr_data[0],
+			op->frag_pcr_data[1],
+			op->frag_pcr_data[2],
+			op->frag_pcr_data[3],
+		},
+	};
+	vkCmdClearAttachments(cb, 1, &att, op->rects_len, clear_rects);
+
+	free(clear_rects);
+}
+
+static bool render_pass_submit(struct wlr_render_pass *wlr_pass) {
+	struct wlr_vk_render_pass *pass = get_render_pass(wlr_pass);
+	struct wlr_vk_renderer *renderer = pass->renderer;
+	VkCommandBuffer cb = renderer->current_command_buffer->vk;
+
+	if (pass->rects.size == 0) {
+		goto out;
+	}
+
+	// Upload all clip rects at once, and bind them for the whole pass
+	struct wlr_vk_buffer_span span = vulkan_get_stage_span(renderer,
+		pass->rects.size, sizeof(float[4]));
+	if (span.buffer == NULL) {
+		wlr_log(WLR_ERROR, "Failed to allocate render pass clip rects");
+		goto out;
+	}
+
+	char *map = (char *)span.buffer->cpu_mapping + span.alloc.start;
+	memcpy(map, pass->rects.data, pass->rects.size);
+
+	vkCmdBindVertexBuffers(cb, 0, 1, &span.buffer->buffer, &span.alloc.start);
+
+	VkPipelineLayout bound_layout = VK_NULL_HANDLE;
+	VkDescriptorSet bound_ds = VK_NULL_HANDLE;
+	struct wlr_vk_render_op *op;
+	wl_array_for_each(op, &pass->ops) {
+		if (op->rects_len == 0) {
+			continue;
+		}
+
+		if (op->type == WLR_VK_RENDER_OP_CLEAR) {
+			render_op_clear(pass, op);
+			continue;
+		}
+
+		if (op->pipe != renderer->bound_pipe) {
+			vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, op->pipe);
+			renderer->bound_pipe = op->pipe;
+		}
+
+		if (op->ds != VK_NULL_HANDLE &&
+				(op->ds != bound_ds || op->pipe_layout != bound_layout)) {
+			vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS,
+				op->pipe_layout, 0, 1, &op->ds, 0, NULL);
+			bound_ds = op->ds;
+			bound_layout = op->pipe_layout;
+		}
+
+		vkCmdPushConstants(cb, op->pipe_layout, VK_SHADER_STAGE_VERTEX_BIT,
+			0, sizeof(op->vert_pcr_data), &op->vert_pcr_data);
+		vkCmdPushConstants(cb, op->pipe_layout, VK_SHADER_STAGE_FRAGMENT_BIT,
+			sizeof(op->vert_pcr_data), op->frag_pcr_size, op->frag_pcr_data);
+		vkCmdDraw(cb, 4, op->rects_len, 0, op->first_rect);
+	}
+
+out:
+	wlr_renderer_end(&renderer->wlr_renderer);
+
+	wl_array_release(&pass->ops);
+	wl_array_release(&pass->rects);
+	free(pass);
+	return true;
+}
+
+static const struct wlr_render_pass_impl render_pass_impl = {
+	.submit = render_pass_submit,
+	.add_texture = render_pass_add_texture,
+	.add_rect = render_pass_add_rect,
+};
+
+struct wlr_vk_render_pass *vulkan_begin_render_pass(
+		struct wlr_vk_renderer *renderer, struct wlr_buffer *buffer) {
+	struct wlr_renderer *wlr_renderer = &renderer->wlr_renderer;
+	if (wlr_renderer->rendering) {
+		return NULL;
+	}
+
+	struct wlr_vk_render_pass *pass = calloc(1, sizeof(*pass));
+	if (pass == NULL) {
+		return NULL;
+	}
+
+	wlr_render_pass_init(&pass->base, &render_pass_impl);
+	pass->renderer = renderer;
+	pass->width = buffer->width;
+	pass->height = buffer->height;
+	wl_array_init(&pass->ops);
+	wl_array_init(&pass->rects);
+
+	if (!wlr_renderer_begin_with_buffer(wlr_renderer, buffer)) {
+		free(pass);
+		return NULL;
+	}
+
+	return pass;
+}
@@ -22,6 +22,7 @@
 #include "render/dmabuf.h"
 #include "render/pixel_format.h"
 #include "render/vulkan.h"
+#include "render/upload_worker.h"
 #include "render/vulkan/shaders/common.vert.h"
 #include "render/vulkan/shaders/texture.frag.h"
 #include "render/vulkan/shaders/quad.frag.h"
@@ -58,21 +59,31 @@ struct wlr_vk_renderer *vulkan_get_renderer(struct wlr_renderer *wlr_renderer) {
 static struct wlr_vk_render_format_setup *find_or_create_render_setup(
 		struct wlr_vk_renderer *renderer, VkFormat format, bool has_blending_buffer);
 
-// vertex shader push constant range data
-struct vert_pcr_data {
-	float mat4[4][4];
-	float uv_off[2];
-	float uv_size[2];
+// Full unit quad clip rectangle, used for draws without clipping
+static const float unit_rect[4] = { 0.f, 0.f, 1.f, 1.f };
+
+// Per-instance clip rectangle bound at binding 0, see shaders/common.vert
+static const VkVertexInputBindingDescription instance_rect_binding = {
+	.binding = 0,
+	.stride = sizeof(float[4]),
+	.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE,
+};
+
+static const VkVertexInputAttributeDescription instance_rect_attrib = {
+	.location = 0,
+	.binding = 0,
+	.format = VK_FORMAT_R32G32B32A32_SFLOAT,
+	.offset = 0,
 };
 
 // https://www.w3.org/Graphics/Color/srgb
-static float color_to_linear(float non_linear) {
+float vulkan_color_to_linear(float non_linear) {
 	return (non_linear > 0.04045) ?
 		pow((non_linear + 0.055) / 1.055, 2.4) :
 		non_linear / 12.92;
 }
 
-static void mat3_to_mat4(const float mat3[9], float mat4[4][4]) {
+void vulkan_mat3_to_mat4(const float mat3[9], float mat4[4][4]) {
 	memset(mat4, 0, sizeof(float) * 16);
 	mat4[0][0] = mat3[0];
 	mat4[0][1] = mat3[1];
@@ -207,6 +218,9 @@ static void shared_buffer_destroy(struct wlr_vk_renderer *r,
 	}
 
 	wl_array_release(&buffer->allocs);
+	if (buffer->cpu_mapping) {
+		vkUnmapMemory(r->dev->dev, buffer->memory);
+	}
 	if (buffer->buffer) {
 		vkDestroyBuffer(r->dev->dev, buffer->buffer, NULL);
 	}
@@ -294,7 +308,8 @@ struct wlr_vk_buffer_span vulkan_get_stage_span(struct wlr_vk_renderer *r,
 		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
 		.size = bsize,
 		.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT |
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
 		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
 	};
 	res = vkCreateBuffer(r->dev->dev, &buf_info, NULL, &buf->buffer);
@@ -331,6 +346,13 @@ struct wlr_vk_buffer_span vulkan_get_stage_span(struct wlr_vk_renderer *r,
 		goto error;
 	}
 
+	res = vkMapMemory(r->dev->dev, buf->memory, 0, VK_WHOLE_SIZE, 0,
+		&buf->cpu_mapping);
+	if (res != VK_SUCCESS) {
+		wlr_vk_error("vkMapMemory", res);
+		goto error;
+	}
+
 	struct wlr_vk_allocation *a = wl_array_add(&buf->allocs, sizeof(*a));
 	if (a == NULL) {
 		wlr_log_errno(WLR_ERROR, "Allocation failed");
@@ -383,11 +405,21 @@ VkCommandBuffer vulkan_record_stage_cb(struct wlr_vk_renderer *renderer) {
 	return renderer->stage.cb->vk;
 }
 
+void vulkan_finish_uploads(struct wlr_vk_renderer *renderer) {
+	struct wlr_upload_job **job_ptr;
+	wl_array_for_each(job_ptr, &renderer->pending_uploads) {
+		upload_job_finish(renderer->upload_worker, *job_ptr);
+	}
+	renderer->pending_uploads.size = 0;
+}
+
 bool vulkan_submit_stage_wait(struct wlr_vk_renderer *renderer) {
 	if (renderer->stage.cb == NULL) {
 		return false;
 	}
 
+	vulkan_finish_uploads(renderer);
+
 	struct wlr_vk_command_buffer *cb = renderer->stage.cb;
 	renderer->stage.cb = NULL;
 
@@ -936,6 +968,10 @@ static bool vulkan_begin(struct wlr_renderer *wlr_renderer,
 	vkCmdSetViewport(cb->vk, 0, 1, &vp);
 	vkCmdSetScissor(cb->vk, 0, 1, &rect);
 
+	VkDeviceSize unit_rect_offset = 0;
+	vkCmdBindVertexBuffers(cb->vk, 0, 1, &renderer->unit_rect_buffer,
+		&unit_rect_offset);
+
 	// Refresh projection matrix.
 	// matrix_projection() assumes a GL coordinate system so we need
 	// to pass WL_OUTPUT_TRANSFORM_FLIPPED_180 to adjust it for vulkan.
@@ -1078,6 +1114,8 @@ static void vulkan_end(struct wlr_renderer *wlr_renderer) {
 	assert(stage_cb != NULL);
 	renderer->stage.cb = NULL;
 
+	vulkan_finish_uploads(renderer);
+
 	struct wlr_vk_render_buffer *current_rb = renderer->current_render_buffer;
 
 	if (current_rb->blend_image) {
@@ -1095,8 +1133,8 @@ static void vulkan_end(struct wlr_renderer *wlr_renderer) {
 			0.f, renderer->render_height, -1.f,
 			0.f, 0.f, 0.f,
 		};
-		struct vert_pcr_data vert_pcr_data;
-		mat3_to_mat4(final_matrix, vert_pcr_data.mat4);
+		struct wlr_vk_vert_pcr_data vert_pcr_data;
+		vulkan_mat3_to_mat4(final_matrix, vert_pcr_data.mat4);
 		vert_pcr_data.uv_off[0] = 0.f;
 		vert_pcr_data.uv_off[1] = 0.f;
 		vert_pcr_data.uv_size[0] = 1.f;
@@ -1108,6 +1146,11 @@ static void vulkan_end(struct wlr_renderer *wlr_renderer) {
 			VK_PIPELINE_BIND_POINT_GRAPHICS, renderer->output_pipe_layout,
 			0, 1, &current_rb->blend_descriptor_set, 0, NULL);
 
+		// A render pass may have bound its own clip rectangles
+		VkDeviceSize unit_rect_offset = 0;
+		vkCmdBindVertexBuffers(render_cb->vk, 0, 1, &renderer->unit_rect_buffer,
+			&unit_rect_offset);
+
 		vkCmdDraw(render_cb->vk, 4, 1, 0, 0);
 	}
 
@@ -1375,13 +1418,15 @@ static void vulkan_end(struct wlr_renderer *wlr_renderer) {
 
 	free(render_wait);
 
+	// Stage buffers may also hold clip rectangles read by the render command
+	// buffer, so only release them once it has completed
 	struct wlr_vk_shared_buffer *stage_buf, *stage_buf_tmp;
 	wl_list_for_each_safe(stage_buf, stage_buf_tmp, &renderer->stage.buffers, link) {
 		if (stage_buf->allocs.size == 0) {
 			continue;
 		}
 		wl_list_remove(&stage_buf->link);
-		wl_list_insert(&stage_cb->stage_buffers, &stage_buf->link);
+		wl_list_insert(&render_cb->stage_buffers, &stage_buf->link);
 	}
 
 	if (!vulkan_sync_render_buffer(renderer, render_cb)) {
@@ -1389,7 +1434,7 @@ static void vulkan_end(struct wlr_renderer *wlr_renderer) {
 	}
 }
 
-static VkPipeline get_texture_pipeline(struct wlr_vk_texture *texture,
+VkPipeline vulkan_get_texture_pipeline(struct wlr_vk_texture *texture,
 		struct wlr_vk_render_format_setup *render_setup) {
 	if (texture->format->is_ycbcr) {
 		size_t pipeline_layout_index = texture->pipeline_layout - texture->renderer->ycbcr_pipeline_layouts;
@@ -1404,14 +1449,10 @@ static VkPipeline get_texture_pipeline(struct wlr_vk_texture *texture,
 	}
 }
 
-static bool vulkan_render_subtexture_with_matrix(struct wlr_renderer *wlr_renderer,
-		struct wlr_texture *wlr_texture, const struct wlr_fbox *box,
-		const float matrix[static 9], float alpha) {
-	struct wlr_vk_renderer *renderer = vulkan_get_renderer(wlr_renderer);
-	VkCommandBuffer cb = renderer->current_command_buffer->vk;
+void vulkan_use_texture(struct wlr_vk_texture *texture) {
+	struct wlr_vk_renderer *renderer = texture->renderer;
+	assert(renderer->current_command_buffer != NULL);
 
-	struct wlr_vk_texture *texture = vulkan_get_texture(wlr_texture);
-	assert(texture->renderer == renderer);
 	if (texture->dmabuf_imported && !texture->owned) {
 		// Store this texture in the list of textures that need to be
 		// acquired before rendering and released after rendering.
@@ -1425,8 +1466,22 @@ static bool vulkan_render_subtexture_with_matrix(struct wlr_renderer *wlr_render
 		wl_list_insert(&renderer->foreign_textures, &texture->foreign_link);
 	}
 
+	texture->last_used_cb = renderer->current_command_buffer;
+}
+
+static bool vulkan_render_subtexture_with_matrix(struct wlr_renderer *wlr_renderer,
+		struct wlr_texture *wlr_texture, const struct wlr_fbox *box,
+		const float matrix[static 9], float alpha) {
+	struct wlr_vk_renderer *renderer = vulkan_get_renderer(wlr_renderer);
+	VkCommandBuffer cb = renderer->current_command_buffer->vk;
+
+	struct wlr_vk_texture *texture = vulkan_get_texture(wlr_texture);
+	assert(texture->renderer == renderer);
+	vulkan_use_texture(texture);
+
 	VkPipelineLayout pipe_layout = texture->pipeline_layout->vk;
-	VkPipeline pipe = get_texture_pipeline(texture, renderer->current_render_buffer->render_setup);
+	VkPipeline pipe = vulkan_get_texture_pipeline(texture,
+		renderer->current_render_buffer->render_setup);
 
 	if (pipe != renderer->bound_pipe) {
 		vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, pipe);
@@ -1439,8 +1494,8 @@ static bool vulkan_render_subtexture_with_matrix(struct wlr_renderer *wlr_render
 	float final_matrix[9];
 	wlr_matrix_multiply(final_matrix, renderer->projection, matrix);
 
-	struct vert_pcr_data vert_pcr_data;
-	mat3_to_mat4(final_matrix, vert_pcr_data.mat4);
+	struct wlr_vk_vert_pcr_data vert_pcr_data;
+	vulkan_mat3_to_mat4(final_matrix, vert_pcr_data.mat4);
 
 	vert_pcr_data.uv_off[0] = box->x / wlr_texture->width;
 	vert_pcr_data.uv_off[1] = box->y / wlr_texture->height;
@@ -1453,7 +1508,6 @@ static bool vulkan_render_subtexture_with_matrix(struct wlr_renderer *wlr_render
 		VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(vert_pcr_data), sizeof(float),
 		&alpha);
 	vkCmdDraw(cb, 4, 1, 0, 0);
-	texture->last_used_cb = renderer->current_command_buffer;
 
 	return true;
 }
@@ -1477,9 +1531,9 @@ static void vulkan_clear(struct wlr_renderer *wlr_renderer,
 		// But in other parts of wlroots we just always assume
 		// srgb so that's why we have to convert here.
 		.clearValue.color.float32 = {
-			color_to_linear(color[0]),
-			color_to_linear(color[1]),
-			color_to_linear(color[2]),
+			vulkan_color_to_linear(color[0]),
+			vulkan_color_to_linear(color[1]),
+			vulkan_color_to_linear(color[2]),
 			color[3], // no conversion for alpha
 		},
 	};
@@ -1529,8 +1583,8 @@ static void vulkan_render_quad_with_matrix(struct wlr_renderer *wlr_renderer,
 	float final_matrix[9];
 	wlr_matrix_multiply(final_matrix, renderer->projection, matrix);
 
-	struct vert_pcr_data vert_pcr_data;
-	mat3_to_mat4(final_matrix, vert_pcr_data.mat4);
+	struct wlr_vk_vert_pcr_data vert_pcr_data;
+	vulkan_mat3_to_mat4(final_matrix, vert_pcr_data.mat4);
 	vert_pcr_data.uv_off[0] = 0.f;
 	vert_pcr_data.uv_off[1] = 0.f;
 	vert_pcr_data.uv_size[0] = 1.f;
@@ -1544,9 +1598,9 @@ static void vulkan_render_quad_with_matrix(struct wlr_renderer *wlr_renderer,
 	// But in other parts of wlroots we just always assume
 	// srgb so that's why we have to convert here.
 	float linear_color[4];
-	linear_color[0] = color_to_linear(color[0]);
-	linear_color[1] = color_to_linear(color[1]);
-	linear_color[2] = color_to_linear(color[2]);
+	linear_color[0] = vulkan_color_to_linear(color[0]);
+	linear_color[1] = vulkan_color_to_linear(color[1]);
+	linear_color[2] = vulkan_color_to_linear(color[2]);
 	linear_color[3] = color[3]; // no conversion for alpha
 
 	vkCmdPushConstants(cb, renderer->default_pipeline_layout.vk,
@@ -1600,6 +1654,15 @@ static void vulkan_destroy(struct wlr_renderer *wlr_renderer) {
 
 	assert(!renderer->current_render_buffer);
 
+	vulkan_finish_uploads(renderer);
+	wl_array_release(&renderer->pending_uploads);
+	upload_worker_destroy(renderer->upload_worker);
+	// The idle source is gone along with its event loop
+	if (renderer->uploads_idle != NULL &&
+			renderer->wlr_renderer.event_loop != NULL) {
+		wl_event_source_remove(renderer->uploads_idle);
+	}
+
 	VkResult res = vkDeviceWaitIdle(renderer->dev->dev);
 	if (res != VK_SUCCESS) {
 		wlr_vk_error("vkDeviceWaitIdle", res);
@@ -1649,6 +1712,9 @@ static void vulkan_destroy(struct wlr_renderer *wlr_renderer) {
 		free(pool);
 	}
 
+	vkDestroyBuffer(dev->dev, renderer->unit_rect_buffer, NULL);
+	vkFreeMemory(dev->dev, renderer->unit_rect_memory, NULL);
+
 	vkDestroyShaderModule(dev->dev, renderer->vert_module, NULL);
 	vkDestroyShaderModule(dev->dev, renderer->tex_frag_module, NULL);
 	vkDestroyShaderModule(dev->dev, renderer->quad_frag_module, NULL);
@@ -1915,6 +1981,17 @@ static uint32_t vulkan_get_render_buffer_caps(struct wlr_renderer *wlr_renderer)
 	return WLR_BUFFER_CAP_DMABUF;
 }
 
+static struct wlr_render_pass *vulkan_begin_buffer_pass(struct wlr_renderer *wlr_renderer,
+		struct wlr_buffer *buffer) {
+	struct wlr_vk_renderer *renderer = vulkan_get_renderer(wlr_renderer);
+
+	struct wlr_vk_render_pass *pass = vulkan_begin_render_pass(renderer, buffer);
+	if (pass == NULL) {
+		return NULL;
+	}
+	return &pass->base;
+}
+
 static const struct wlr_renderer_impl renderer_impl = {
 	.bind_buffer = vulkan_bind_buffer,
 	.begin = vulkan_begin,
@@ -1932,6 +2009,7 @@ static const struct wlr_renderer_impl renderer_impl = {
 	.get_drm_fd = vulkan_get_drm_fd,
 	.get_render_buffer_caps = vulkan_get_render_buffer_caps,
 	.texture_from_buffer = vulkan_texture_from_buffer,
+	.begin_buffer_pass = vulkan_begin_buffer_pass,
 };
 
 static bool init_sampler(struct wlr_vk_renderer *renderer, VkSampler *sampler,
@@ -1996,7 +2074,7 @@ static bool init_tex_layouts(struct wlr_vk_renderer *renderer,
 
 	VkPushConstantRange pc_ranges[2] = {
 		{
-			.size = sizeof(struct vert_pcr_data),
+			.size = sizeof(struct wlr_vk_vert_pcr_data),
 			.stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
 		},
 		{
@@ -2052,7 +2130,7 @@ static bool init_blend_to_output_layouts(struct wlr_vk_renderer *renderer,
 	// pipeline layout -- standard vertex uniforms, no shader uniforms
 	VkPushConstantRange pc_ranges[1] = {
 		{
-			.size = sizeof(struct vert_pcr_data),
+			.size = sizeof(struct wlr_vk_vert_pcr_data),
 			.stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
 		},
 	};
@@ -2171,6 +2249,10 @@ static bool init_tex_pipeline(struct wlr_vk_renderer *renderer,
 
 	VkPipelineVertexInputStateCreateInfo vertex = {
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+		.vertexBindingDescriptionCount = 1,
+		.pVertexBindingDescriptions = &instance_rect_binding,
+		.vertexAttributeDescriptionCount = 1,
+		.pVertexAttributeDescriptions = &instance_rect_attrib,
 	};
 
 	VkGraphicsPipelineCreateInfo pinfo = {
@@ -2277,6 +2359,10 @@ static bool init_quad_pipeline(struct wlr_vk_renderer *renderer,
 
 	VkPipelineVertexInputStateCreateInfo vertex = {
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+		.vertexBindingDescriptionCount = 1,
+		.pVertexBindingDescriptions = &instance_rect_binding,
+		.vertexAttributeDescriptionCount = 1,
+		.pVertexAttributeDescriptions = &instance_rect_attrib,
 	};
 
 	VkGraphicsPipelineCreateInfo pinfo = {
@@ -2376,6 +2462,10 @@ static bool init_blend_to_output_pipeline(struct wlr_vk_renderer *renderer,
 
 	VkPipelineVertexInputStateCreateInfo vertex = {
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+		.vertexBindingDescriptionCount = 1,
+		.pVertexBindingDescriptions = &instance_rect_binding,
+		.vertexAttributeDescriptionCount = 1,
+		.pVertexAttributeDescriptions = &instance_rect_attrib,
 	};
 
 	VkGraphicsPipelineCreateInfo pinfo = {
@@ -2445,6 +2535,65 @@ static bool init_ycbcr_pipeline_layout(struct wlr_vk_renderer *renderer,
 	return init_pipeline_layout(renderer, pipeline_layout);
 }
 
+// Creates the vertex buffer holding the unit rectangle, in host memory.
+static bool init_unit_rect_buffer(struct wlr_vk_renderer *renderer) {
+	VkResult res;
+	VkDevice dev = renderer->dev->dev;
+
+	VkBufferCreateInfo buf_info = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size = sizeof(unit_rect),
+		.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+	};
+	res = vkCreateBuffer(dev, &buf_info, NULL, &renderer->unit_rect_buffer);
+	if (res != VK_SUCCESS) {
+		wlr_vk_error("vkCreateBuffer", res);
+		return false;
+	}
+
+	VkMemoryRequirements mem_reqs;
+	vkGetBufferMemoryRequirements(dev, renderer->unit_rect_buffer, &mem_reqs);
+
+	int mem_type_index = vulkan_find_mem_type(renderer->dev,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, mem_reqs.memoryTypeBits);
+	if (mem_type_index < 0) {
+		wlr_log(WLR_ERROR, "Failed to find memory type");
+		return false;
+	}
+
+	VkMemoryAllocateInfo mem_info = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		.allocationSize = mem_reqs.size,
+		.memoryTypeIndex = (uint32_t)mem_type_index,
+	};
+	res = vkAllocateMemory(dev, &mem_info, NULL, &renderer->unit_rect_memory);
+	if (res != VK_SUCCESS) {
+		wlr_vk_error("vkAllocateMemory", res);
+		return false;
+	}
+
+	res = vkBindBufferMemory(dev, renderer->unit_rect_buffer,
+		renderer->unit_rect_memory, 0);
+	if (res != VK_SUCCESS) {
+		wlr_vk_error("vkBindBufferMemory", res);
+		return false;
+	}
+
+	void *map;
+	res = vkMapMemory(dev, renderer->unit_rect_memory, 0, sizeof(unit_rect),
+		0, &map);
+	if (res != VK_SUCCESS) {
+		wlr_vk_error("vkMapMemory", res);
+		return false;
+	}
+	memcpy(map, unit_rect, sizeof(unit_rect));
+	vkUnmapMemory(dev, renderer->unit_rect_memory);
+
+	return true;
+}
+
 // Creates static render data, such as sampler, layouts and shader modules
 // for the given rednerer.
 // Cleanup is done by destroying the renderer.
@@ -2456,6 +2605,10 @@ static bool init_static_render_data(struct wlr_vk_renderer *renderer) {
 		return false;
 	}
 
+	if (!init_unit_rect_buffer(renderer)) {
+		return false;
+	}
+
 	size_t ycbcr_formats_len = 0;
 	for (size_t i = 0; i < renderer->dev->format_prop_count; i++) {
 		struct wlr_vk_format_props *props = &renderer->dev->format_props[i];
@@ -2802,6 +2955,7 @@ struct wlr_renderer *vulkan_renderer_create_for_device(struct wlr_vk_device *dev
 	wl_list_init(&renderer->output_descriptor_pools);
 	wl_list_init(&renderer->render_format_setups);
 	wl_list_init(&renderer->render_buffers);
+	wl_array_init(&renderer->pending_uploads);
 
 	if (!init_static_render_data(renderer)) {
 		goto error;
@@ -2835,6 +2989,8 @@ struct wlr_renderer *vulkan_renderer_create_for_device(struct wlr_vk_device *dev
 		goto error;
 	}
 
+	renderer->upload_worker = upload_worker_create();
+
 	return &renderer->wlr_renderer;
 
 error:
@@ -8,11 +8,16 @@ layout(push_constant, row_major) uniform UBO {
 	vec2 uv_size;
 } data;
 
+// Per-instance rectangle (x1, y1, x2, y2) to draw, in the space mapped by
+// proj. Draws without clipping use the unit rectangle.
+layout(location = 0) in vec4 rect;
+
 layout(location = 0) out vec2 uv;
 
 void main() {
-	vec2 pos = vec2(float((gl_VertexIndex + 1) & 2) * 0.5f,
+	vec2 corner = vec2(float((gl_VertexIndex + 1) & 2) * 0.5f,
 		float(gl_VertexIndex & 2) * 0.5f);
+	vec2 pos = mix(rect.xy, rect.zw, corner);
 	uv = data.uv_offset + pos * data.uv_size;
 	gl_Position = data.proj * vec4(pos, 0.0, 1.0);
 }
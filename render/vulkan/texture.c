@@ -12,6 +12,7 @@
 #include <wlr/util/log.h>
 #include <xf86drm.h>
 #include "render/pixel_format.h"
+#include "render/upload_worker.h"
 #include "render/vulkan.h"
 
 static const struct wlr_texture_impl texture_impl;
@@ -35,15 +36,34 @@ static VkImageAspectFlagBits mem_plane_aspect(unsigned i) {
 	}
 }
 
+static void handle_uploads_idle(void *data) {
+	struct wlr_vk_renderer *renderer = data;
+	renderer->uploads_idle = NULL;
+	vulkan_finish_uploads(renderer);
+}
+
+// Pending upload jobs keep accessing their buffer's data until finished
+static void finish_buffer_uploads(struct wlr_vk_renderer *renderer,
+		struct wlr_buffer *buffer) {
+	struct wlr_upload_job **job_ptr;
+	wl_array_for_each(job_ptr, &renderer->pending_uploads) {
+		if ((*job_ptr)->buffer == buffer) {
+			vulkan_finish_uploads(renderer);
+			return;
+		}
+	}
+}
+
 // Will transition the texture to shaderReadOnlyOptimal layout for reading
-// from fragment shader later on
+// from fragment shader later on. If async_buffer is non-NULL, the staging
+// buffer is filled from vdata by the upload worker, which takes over the data
+// pointer access to async_buffer on success.
 static bool write_pixels(struct wlr_vk_texture *texture,
 		uint32_t stride, const pixman_region32_t *region, const void *vdata,
+		struct wlr_buffer *async_buffer,
 		VkImageLayout old_layout, VkPipelineStageFlags src_stage,
 		VkAccessFlags src_access) {
-	VkResult res;
 	struct wlr_vk_renderer *renderer = texture->renderer;
-	VkDevice dev = texture->renderer->dev->dev;
 
 	const struct wlr_pixel_format_info *format_info = drm_get_pixel_format_info(texture->format->drm);
 	assert(format_info);
@@ -80,15 +100,32 @@ static bool write_pixels(struct wlr_vk_texture *texture,
 		return false;
 	}
 
-	void *vmap;
-	res = vkMapMemory(dev, span.buffer->memory, span.alloc.start,
-		bsize, 0, &vmap);
-	if (res != VK_SUCCESS) {
-		wlr_vk_error("vkMapMemory", res);
-		free(copies);
-		return false;
+	char *vmap = (char *)span.buffer->cpu_mapping + span.alloc.start;
+	char *map = vmap;
+
+	if (async_buffer != NULL) {
+		struct wlr_upload_job **job_ptr =
+			wl_array_add(&renderer->pending_uploads, sizeof(*job_ptr));
+		if (job_ptr == NULL) {
+			free(copies);
+			return false;
+		}
+		// The worker packs rects the same way as below
+		*job_ptr = upload_worker_submit(renderer->upload_worker, async_buffer,
+			vdata, stride, region, format_info->bytes_per_block, map);
+		if (*job_ptr == NULL) {
+			renderer->pending_uploads.size -= sizeof(*job_ptr);
+			free(copies);
+			return false;
+		}
+
+		// Release the buffer without waiting for the next frame
+		struct wl_event_loop *loop = renderer->wlr_renderer.event_loop;
+		if (renderer->uploads_idle == NULL && loop != NULL) {
+			renderer->uploads_idle =
+				wl_event_loop_add_idle(loop, handle_uploads_idle, renderer);
+		}
 	}
-	char *map = (char *)vmap;
 
 	// upload data
 
@@ -102,18 +139,22 @@ static bool write_pixels(struct wlr_vk_texture *texture,
 		uint32_t packed_stride = (uint32_t)pixel_format_info_min_stride(format_info, width);
 
 		// write data into staging buffer span
-		const char *pdata = vdata; // data iterator
-		pdata += stride * src_y;
-		pdata += format_info->bytes_per_block * src_x;
-		if (src_x == 0 && width == texture->wlr_texture.width &&
-				stride == packed_stride) {
-			memcpy(map, pdata, packed_stride * height);
+		if (async_buffer != NULL) {
 			map += packed_stride * height;
 		} else {
-			for (unsigned i = 0u; i < height; ++i) {
-				memcpy(map, pdata, packed_stride);
-				pdata += stride;
-				map += packed_stride;
+			const char *pdata = vdata; // data iterator
+			pdata += stride * src_y;
+			pdata += format_info->bytes_per_block * src_x;
+			if (src_x == 0 && width == texture->wlr_texture.width &&
+					stride == packed_stride) {
+				memcpy(map, pdata, packed_stride * height);
+				map += packed_stride * height;
+			} else {
+				for (unsigned i = 0u; i < height; ++i) {
+					memcpy(map, pdata, packed_stride);
+					pdata += stride;
+					map += packed_stride;
+				}
 			}
 		}
 
@@ -137,8 +178,7 @@ static bool write_pixels(struct wlr_vk_texture *texture,
 		buf_off += height * packed_stride;
 	}
 
-	assert((uint32_t)(map - (char *)vmap) == bsize);
-	vkUnmapMemory(dev, span.buffer->memory);
+	assert((uint32_t)(map - vmap) == bsize);
 
 	// record staging cb
 	// will be executed before next frame
@@ -166,6 +206,8 @@ static bool vulkan_texture_update_from_buffer(struct wlr_texture *wlr_texture,
 		struct wlr_buffer *buffer, const pixman_region32_t *damage) {
 	struct wlr_vk_texture *texture = vulkan_get_texture(wlr_texture);
 
+	finish_buffer_uploads(texture->renderer, buffer);
+
 	void *data;
 	uint32_t format;
 	size_t stride;
@@ -174,18 +216,26 @@ static bool vulkan_texture_update_from_buffer(struct wlr_texture *wlr_texture,
 		return false;
 	}
 
-	bool ok = true;
-
 	if (format != texture->format->drm) {
-		ok = false;
-		goto out;
+		wlr_buffer_end_data_ptr_access(buffer);
+		return false;
 	}
 
-	ok = write_pixels(texture, stride, damage, data, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+	// Block formats aren't tightly packed per pixel, upload them inline
+	struct wlr_buffer *async_buffer = NULL;
+	if (texture->renderer->upload_worker != NULL &&
+			pixel_format_info_pixels_per_block(
+				drm_get_pixel_format_info(format)) == 1) {
+		async_buffer = buffer;
+	}
+
+	bool ok = write_pixels(texture, stride, damage, data, async_buffer,
+		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
 		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
 
-out:
-	wlr_buffer_end_data_ptr_access(buffer);
+	if (async_buffer == NULL || !ok) {
+		wlr_buffer_end_data_ptr_access(buffer);
+	}
 	return ok;
 }
 
@@ -388,8 +438,8 @@ static struct wlr_texture *vulkan_texture_from_pixels(
 
 	pixman_region32_t region;
 	pixman_region32_init_rect(&region, 0, 0, width, height);
-	if (!write_pixels(texture, stride, &region, data, VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0)) {
+	if (!write_pixels(texture, stride, &region, data, NULL,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0)) {
 		goto error;
 	}
 
@@ -794,7 +844,10 @@ struct wlr_texture *vulkan_texture_from_buffer(struct wlr_renderer *wlr_renderer
 	struct wlr_dmabuf_attributes dmabuf;
 	if (wlr_buffer_get_dmabuf(buffer, &dmabuf)) {
 		return vulkan_texture_from_dmabuf_buffer(renderer, buffer, &dmabuf);
-	} else if (wlr_buffer_begin_data_ptr_access(buffer,
+	}
+
+	finish_buffer_uploads(renderer, buffer);
+	if (wlr_buffer_begin_data_ptr_access(buffer,
 			WLR_BUFFER_DATA_PTR_ACCESS_READ, &data, &format, &stride)) {
 		struct wlr_texture *tex = vulkan_texture_from_pixels(renderer,
 			format, stride, buffer->width, buffer->height, data);
@@ -49,6 +49,7 @@ void wlr_renderer_init(struct wlr_renderer *renderer,
 
 	wl_signal_init(&renderer->events.destroy);
 	wl_signal_init(&renderer->events.lost);
+	wl_list_init(&renderer->event_loop_destroy.link);
 }
 
 void wlr_renderer_destroy(struct wlr_renderer *r) {
@@ -60,6 +61,8 @@ void wlr_renderer_destroy(struct wlr_renderer *r) {
 
 	wl_signal_emit_mutable(&r->events.destroy, r);
 
+	wl_list_remove(&r->event_loop_destroy.link);
+
 	if (r->impl && r->impl->destroy) {
 		r->impl->destroy(r);
 	} else {
@@ -67,6 +70,29 @@ void wlr_renderer_destroy(struct wlr_renderer *r) {
 	}
 }
 
+static void handle_event_loop_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_renderer *r = wl_container_of(listener, r, event_loop_destroy);
+	wl_list_remove(&r->event_loop_destroy.link);
+	wl_list_init(&r->event_loop_destroy.link);
+	r->event_loop = NULL;
+}
+
+void renderer_set_event_loop(struct wlr_renderer *r,
+		struct wl_event_loop *loop) {
+	if (r->event_loop == loop) {
+		return;
+	}
+
+	wl_list_remove(&r->event_loop_destroy.link);
+	wl_list_init(&r->event_loop_destroy.link);
+	r->event_loop = loop;
+	if (loop != NULL) {
+		r->event_loop_destroy.notify = handle_event_loop_destroy;
+		wl_event_loop_add_destroy_listener(loop, &r->event_loop_destroy);
+	}
+}
+
 bool renderer_bind_buffer(struct wlr_renderer *r, struct wlr_buffer *buffer) {
 	assert(!r->rendering);
 	if (!r->impl->bind_buffer) {
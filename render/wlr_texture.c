@@ -90,3 +90,11 @@ bool wlr_texture_update_from_buffer(struct wlr_texture *texture,
 	}
 	return texture->impl->update_from_buffer(texture, buffer, damage);
 }
+
+bool wlr_texture_read_pixels(struct wlr_texture *texture, uint32_t fmt,
+		uint32_t stride, void *data) {
+	if (!texture->impl->read_pixels) {
+		return false;
+	}
+	return texture->impl->read_pixels(texture, fmt, stride, data);
+}
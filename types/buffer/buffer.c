@@ -1,9 +1,19 @@
 #include <assert.h>
+#include <drm_fourcc.h>
+#include <stdlib.h>
 #include <string.h>
+#include <wayland-util.h>
 #include <wlr/interfaces/wlr_buffer.h>
+#include <wlr/types/wlr_single_pixel_buffer_v1.h>
 #include "render/pixel_format.h"
 #include "types/wlr_buffer.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 void wlr_buffer_init(struct wlr_buffer *buffer,
 		const struct wlr_buffer_impl *impl, int width, int height) {
 	assert(impl->destroy);
@@ -99,6 +109,11 @@ bool wlr_buffer_get_shm(struct wlr_buffer *buffer,
 }
 
 bool buffer_is_opaque(struct wlr_buffer *buffer) {
+	float color[4];
+	if (buffer_get_solid_color(buffer, color)) {
+		return color[3] == 1;
+	}
+
 	void *data;
 	uint32_t format;
 	size_t stride;
@@ -123,3 +138,195 @@ bool buffer_is_opaque(struct wlr_buffer *buffer) {
 
 	return !format_info->has_alpha;
 }
+
+bool buffer_get_solid_color(struct wlr_buffer *buffer, float color[static 4]) {
+	struct wlr_single_pixel_buffer_v1 *single_pixel_buffer =
+		wlr_single_pixel_buffer_v1_try_from_buffer(buffer);
+	if (single_pixel_buffer != NULL) {
+		color[0] = (double)single_pixel_buffer->r / UINT32_MAX;
+		color[1] = (double)single_pixel_buffer->g / UINT32_MAX;
+		color[2] = (double)single_pixel_buffer->b / UINT32_MAX;
+		color[3] = (double)single_pixel_buffer->a / UINT32_MAX;
+		return true;
+	}
+
+	if (buffer->width != 1 || buffer->height != 1) {
+		return false;
+	}
+
+	// The buffer may still be read by an asynchronous texture upload
+	if (buffer->accessing_data_ptr) {
+		return false;
+	}
+
+	void *data;
+	uint32_t format;
+	size_t stride;
+	if (!wlr_buffer_begin_data_ptr_access(buffer,
+			WLR_BUFFER_DATA_PTR_ACCESS_READ, &data, &format, &stride)) {
+		return false;
+	}
+
+	uint8_t px[4]; // DRM formats are little-endian
+	memcpy(px, data, sizeof(px));
+	wlr_buffer_end_data_ptr_access(buffer);
+
+	switch (format) {
+	case DRM_FORMAT_ARGB8888:
+	case DRM_FORMAT_XRGB8888:
+		color[0] = px[2] / 255.0;
+		color[1] = px[1] / 255.0;
+		color[2] = px[0] / 255.0;
+		break;
+	case DRM_FORMAT_ABGR8888:
+	case DRM_FORMAT_XBGR8888:
+		color[0] = px[0] / 255.0;
+		color[1] = px[1] / 255.0;
+		color[2] = px[2] / 255.0;
+		break;
+	default:
+		return false;
+	}
+	if (format == DRM_FORMAT_ARGB8888 || format == DRM_FORMAT_ABGR8888) {
+		color[3] = px[3] / 255.0;
+	} else {
+		color[3] = 1;
+	}
+	return true;
+}
+
+// Opaque spans shorter than this are ignored: they barely help occlusion
+// culling and would fragment the region
+#define MIN_OPAQUE_SPAN 16
+
+static int get_alpha_offset(uint32_t format) {
+	// Byte offset of the 8-bit alpha channel in a little-endian 32-bit pixel
+	switch (format) {
+	case DRM_FORMAT_ARGB8888:
+	case DRM_FORMAT_ABGR8888:
+		return 3;
+	case DRM_FORMAT_RGBA8888:
+	case DRM_FORMAT_BGRA8888:
+		return 0;
+	default:
+		return -1;
+	}
+}
+
+/**
+ * Returns the end of the run of fully opaque pixels starting at x.
+ */
+static int find_opaque_span_end(const uint8_t *row, int x, int end,
+		int alpha_offset) {
+	uint8_t mask[16] = {0};
+	for (size_t i = alpha_offset; i < sizeof(mask); i += 4) {
+		mask[i] = 0xFF;
+	}
+
+#if defined(__SSE2__)
+	const __m128i alpha = _mm_loadu_si128((const __m128i *)mask);
+	for (; x + 4 <= end; x += 4) {
+		__m128i px = _mm_loadu_si128((const __m128i *)&row[4 * x]);
+		__m128i cmp = _mm_cmpeq_epi8(_mm_and_si128(px, alpha), alpha);
+		if (_mm_movemask_epi8(cmp) != 0xFFFF) {
+			break;
+		}
+	}
+#elif defined(__aarch64__)
+	const uint8x16_t alpha = vld1q_u8(mask);
+	for (; x + 4 <= end; x += 4) {
+		uint8x16_t px = vld1q_u8(&row[4 * x]);
+		uint8x16_t cmp = vceqq_u8(vandq_u8(px, alpha), alpha);
+		if (vminvq_u8(cmp) != 0xFF) {
+			break;
+		}
+	}
+#else
+	(void)mask;
+#endif
+
+	while (x < end && row[4 * x + alpha_offset] == 0xFF) {
+		x++;
+	}
+	return x;
+}
+
+static void scan_opaque_rect(const uint8_t *data, size_t stride,
+		int alpha_offset, const pixman_box32_t *rect, struct wl_array *boxes) {
+	for (int y = rect->y1; y < rect->y2; y++) {
+		const uint8_t *row = &data[(size_t)y * stride];
+		int x = rect->x1;
+		while (x < rect->x2) {
+			while (x < rect->x2 && row[4 * x + alpha_offset] != 0xFF) {
+				x++;
+			}
+			int start = x;
+			x = find_opaque_span_end(row, x, rect->x2, alpha_offset);
+			if (x - start < MIN_OPAQUE_SPAN) {
+				continue;
+			}
+
+			pixman_box32_t *box = wl_array_add(boxes, sizeof(*box));
+			if (box == NULL) {
+				return;
+			}
+			*box = (pixman_box32_t){
+				.x1 = start,
+				.y1 = y,
+				.x2 = x,
+				.y2 = y + 1,
+			};
+		}
+	}
+}
+
+bool buffer_update_opaque_region(struct wlr_buffer *buffer,
+		pixman_region32_t *opaque, const pixman_region32_t *damage) {
+	if (buffer->accessing_data_ptr) {
+		return false;
+	}
+
+	void *data;
+	uint32_t format;
+	size_t stride;
+	if (!wlr_buffer_begin_data_ptr_access(buffer,
+			WLR_BUFFER_DATA_PTR_ACCESS_READ, &data, &format, &stride)) {
+		return false;
+	}
+
+	int alpha_offset = get_alpha_offset(format);
+	if (alpha_offset < 0) {
+		wlr_buffer_end_data_ptr_access(buffer);
+		return false;
+	}
+
+	pixman_region32_t scan;
+	pixman_region32_init(&scan);
+	pixman_region32_intersect_rect(&scan, damage,
+		0, 0, buffer->width, buffer->height);
+
+	struct wl_array boxes;
+	wl_array_init(&boxes);
+
+	int rects_len;
+	const pixman_box32_t *rects = pixman_region32_rectangles(&scan, &rects_len);
+	for (int i = 0; i < rects_len; i++) {
+		scan_opaque_rect(data, stride, alpha_offset, &rects[i], &boxes);
+	}
+
+	wlr_buffer_end_data_ptr_access(buffer);
+
+	pixman_region32_t found;
+	pixman_region32_init_rects(&found, boxes.data,
+		boxes.size / sizeof(pixman_box32_t));
+	wl_array_release(&boxes);
+
+	pixman_region32_intersect_rect(opaque, opaque,
+		0, 0, buffer->width, buffer->height);
+	pixman_region32_subtract(opaque, opaque, &scan);
+	pixman_region32_union(opaque, opaque, &found);
+
+	pixman_region32_fini(&found);
+	pixman_region32_fini(&scan);
+	return true;
+}
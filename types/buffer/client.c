@@ -1,8 +1,11 @@
 #include <assert.h>
+#include <drm_fourcc.h>
 #include <stdlib.h>
+#include <string.h>
 #include <wlr/interfaces/wlr_buffer.h>
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/util/log.h>
+#include "render/pixel_format.h"
 #include "types/wlr_buffer.h"
 
 static const struct wlr_buffer_impl client_buffer_impl;
@@ -23,8 +26,10 @@ static struct wlr_client_buffer *client_buffer_from_buffer(
 
 static void client_buffer_destroy(struct wlr_buffer *buffer) {
 	struct wlr_client_buffer *client_buffer = client_buffer_from_buffer(buffer);
+	texture_cache_remove_buffer(client_buffer);
 	wl_list_remove(&client_buffer->source_destroy.link);
 	wlr_texture_destroy(client_buffer->texture);
+	free(client_buffer->evicted_data);
 	free(client_buffer);
 }
 
@@ -55,10 +60,18 @@ static void client_buffer_handle_source_destroy(struct wl_listener *listener,
 
 struct wlr_client_buffer *wlr_client_buffer_create(struct wlr_buffer *buffer,
 		struct wlr_renderer *renderer) {
-	struct wlr_texture *texture = wlr_texture_from_buffer(renderer, buffer);
-	if (texture == NULL) {
-		wlr_log(WLR_ERROR, "Failed to create texture");
-		return NULL;
+	float solid_color[4];
+	bool solid = buffer_get_solid_color(buffer, solid_color);
+
+	// Single-color buffers are drawn as rectangles, their texture is only
+	// created on demand
+	struct wlr_texture *texture = NULL;
+	if (!solid) {
+		texture = wlr_texture_from_buffer(renderer, buffer);
+		if (texture == NULL) {
+			wlr_log(WLR_ERROR, "Failed to create texture");
+			return NULL;
+		}
 	}
 
 	struct wlr_client_buffer *client_buffer =
@@ -68,9 +81,27 @@ struct wlr_client_buffer *wlr_client_buffer_create(struct wlr_buffer *buffer,
 		return NULL;
 	}
 	wlr_buffer_init(&client_buffer->base, &client_buffer_impl,
-		texture->width, texture->height);
+		buffer->width, buffer->height);
 	client_buffer->source = buffer;
 	client_buffer->texture = texture;
+	client_buffer->renderer = renderer;
+	wl_list_init(&client_buffer->texture_cache_link);
+	client_buffer->solid = solid;
+	memcpy(client_buffer->solid_color, solid_color, sizeof(solid_color));
+
+	// Textures are created in the format of the buffer's data, if it has any
+	client_buffer->format = DRM_FORMAT_INVALID;
+	struct wlr_shm_attributes shm;
+	void *data;
+	uint32_t format;
+	size_t stride;
+	if (wlr_buffer_get_shm(buffer, &shm)) {
+		client_buffer->format = shm.format;
+	} else if (wlr_buffer_begin_data_ptr_access(buffer,
+			WLR_BUFFER_DATA_PTR_ACCESS_READ, &data, &format, &stride)) {
+		wlr_buffer_end_data_ptr_access(buffer);
+		client_buffer->format = format;
+	}
 
 	wl_signal_add(&buffer->events.destroy, &client_buffer->source_destroy);
 	client_buffer->source_destroy.notify = client_buffer_handle_source_destroy;
@@ -89,5 +120,73 @@ bool wlr_client_buffer_apply_damage(struct wlr_client_buffer *client_buffer,
 		return false;
 	}
 
+	// Read the buffer before the update possibly hands it over to an upload
+	// worker
+	float solid_color[4];
+	bool solid = buffer_get_solid_color(next, solid_color);
+	if (solid != client_buffer->solid) {
+		return false;
+	}
+
+	if (solid) {
+		// Nothing to upload, the texture is re-created on demand
+		wlr_texture_destroy(client_buffer->texture);
+		client_buffer->texture = NULL;
+		memcpy(client_buffer->solid_color, solid_color, sizeof(solid_color));
+		return true;
+	}
+
+	if (client_buffer->texture == NULL) {
+		// The texture has been evicted, re-creating it from the next buffer
+		// is cheaper than restoring it first
+		return false;
+	}
+
 	return wlr_texture_update_from_buffer(client_buffer->texture, next, damage);
 }
+
+size_t client_buffer_texture_size(struct wlr_client_buffer *buffer) {
+	return (size_t)buffer->base.width * buffer->base.height * 4;
+}
+
+static struct wlr_texture *client_buffer_create_solid_texture(
+		struct wlr_client_buffer *buffer) {
+	// The color is pre-multiplied, like texture contents
+	uint8_t px[4]; // DRM formats are little-endian
+	for (size_t i = 0; i < 4; i++) {
+		px[i] = buffer->solid_color[i] * 255 + 0.5;
+	}
+	buffer->texture = wlr_texture_from_pixels(buffer->renderer,
+		DRM_FORMAT_ABGR8888, sizeof(px), 1, 1, px);
+	if (buffer->texture == NULL) {
+		wlr_log(WLR_ERROR, "Failed to create single-color texture");
+	}
+	return buffer->texture;
+}
+
+struct wlr_texture *wlr_client_buffer_get_texture(
+		struct wlr_client_buffer *buffer) {
+	if (buffer->texture == NULL && buffer->solid) {
+		return client_buffer_create_solid_texture(buffer);
+	}
+	if (buffer->texture != NULL || buffer->evicted_data == NULL) {
+		return buffer->texture;
+	}
+
+	const struct wlr_pixel_format_info *info =
+		drm_get_pixel_format_info(buffer->format);
+	assert(info != NULL);
+	buffer->texture = wlr_texture_from_pixels(buffer->renderer, buffer->format,
+		pixel_format_info_min_stride(info, buffer->base.width),
+		buffer->base.width, buffer->base.height, buffer->evicted_data);
+	if (buffer->texture == NULL) {
+		wlr_log(WLR_ERROR, "Failed to restore evicted texture");
+		return NULL;
+	}
+
+	free(buffer->evicted_data);
+	buffer->evicted_data = NULL;
+	texture_cache_handle_restore(buffer);
+
+	return buffer->texture;
+}
@@ -409,6 +409,10 @@ void wlr_output_destroy(struct wlr_output *output) {
 		wl_event_source_remove(output->idle_done);
 	}
 
+	if (output->idle_swapchain_prealloc != NULL) {
+		wl_event_source_remove(output->idle_swapchain_prealloc);
+	}
+
 	free(output->name);
 	free(output->description);
 	free(output->make);
@@ -3,6 +3,8 @@
 #include <stdlib.h>
 #include <wlr/render/allocator.h>
 #include <wlr/render/swapchain.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_buffer.h>
 #include <wlr/util/log.h>
 #include <xf86drm.h>
 
@@ -63,6 +65,58 @@ static bool test_swapchain(struct wlr_output *output,
 	return ok;
 }
 
+static void prealloc_handle_idle_timer(void *data) {
+	struct wlr_output *output = data;
+	output->idle_swapchain_prealloc = NULL;
+
+	struct wlr_swapchain *swapchain = output->swapchain;
+	if (swapchain == NULL) {
+		return;
+	}
+
+	if (!wlr_swapchain_prealloc(swapchain)) {
+		wlr_log(WLR_ERROR, "Failed to pre-allocate swapchain for output '%s'",
+			output->name);
+		return;
+	}
+
+	if (output->renderer == NULL) {
+		return;
+	}
+
+	// Beginning a render pass imports the buffer into the renderer, which
+	// caches the import for subsequent frames
+	for (size_t i = 0; i < swapchain->len; i++) {
+		struct wlr_swapchain_slot *slot = &swapchain->slots[i];
+		if (slot->buffer == NULL || slot->acquired) {
+			continue;
+		}
+
+		struct wlr_buffer *buffer = wlr_buffer_lock(slot->buffer);
+		struct wlr_render_pass *pass =
+			wlr_renderer_begin_buffer_pass(output->renderer, buffer);
+		if (pass != NULL) {
+			wlr_render_pass_submit(pass);
+		} else {
+			wlr_log(WLR_DEBUG, "Failed to import swapchain buffer for output '%s'",
+				output->name);
+		}
+		wlr_buffer_unlock(buffer);
+	}
+}
+
+static void schedule_swapchain_prealloc(struct wlr_output *output) {
+	if (output->idle_swapchain_prealloc != NULL) {
+		return; // Already scheduled
+	}
+
+	// Allocate from an idle callback, so that the commit which configured
+	// the swapchain isn't delayed
+	struct wl_event_loop *ev = wl_display_get_event_loop(output->display);
+	output->idle_swapchain_prealloc =
+		wl_event_loop_add_idle(ev, prealloc_handle_idle_timer, output);
+}
+
 bool wlr_output_configure_primary_swapchain(struct wlr_output *output,
 		const struct wlr_output_state *state, struct wlr_swapchain **swapchain_ptr) {
 	const struct wlr_output_state empty_state = {0};
@@ -108,5 +162,10 @@ bool wlr_output_configure_primary_swapchain(struct wlr_output *output,
 
 	wlr_swapchain_destroy(*swapchain_ptr);
 	*swapchain_ptr = swapchain;
+
+	if (output->swapchain_prealloc && swapchain_ptr == &output->swapchain) {
+		schedule_swapchain_prealloc(output);
+	}
+
 	return true;
 }
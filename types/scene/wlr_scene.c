@@ -1,8 +1,10 @@
 #define _POSIX_C_SOURCE 200809L
 #include <assert.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <wlr/backend.h>
+#include <wlr/render/recording.h>
 #include <wlr/render/swapchain.h>
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/types/wlr_compositor.h>
@@ -11,6 +13,7 @@
 #include <wlr/types/wlr_linux_dmabuf_v1.h>
 #include <wlr/types/wlr_presentation_time.h>
 #include <wlr/types/wlr_scene.h>
+#include <wlr/types/wlr_texture_cache.h>
 #include <wlr/util/log.h>
 #include <wlr/util/region.h>
 #include "types/wlr_buffer.h"
@@ -55,6 +58,18 @@ struct wlr_scene *scene_node_get_root(struct wlr_scene_node *node) {
 	return (struct wlr_scene *)tree;
 }
 
+/**
+ * Mark the cached bounds of all ancestors of the node as stale. Must be called
+ * whenever the node's size, position or enabled state changes, or when it is
+ * added to or removed from a tree.
+ */
+static void scene_node_invalidate_bounds(struct wlr_scene_node *node) {
+	for (struct wlr_scene_tree *tree = node->parent; tree != NULL;
+			tree = tree->node.parent) {
+		tree->bounds_dirty = true;
+	}
+}
+
 static void scene_node_init(struct wlr_scene_node *node,
 		enum wlr_scene_node_type type, struct wlr_scene_tree *parent) {
 	memset(node, 0, sizeof(*node));
@@ -69,11 +84,59 @@ static void scene_node_init(struct wlr_scene_node *node,
 
 	if (parent != NULL) {
 		wl_list_insert(parent->children.prev, &node->link);
+		scene_node_invalidate_bounds(node);
 	}
 
 	wlr_addon_set_init(&node->addons);
 }
 
+/**
+ * Update whether the current buffer of the node is marked as displayed in the
+ * scene's texture cache. Must be called with false before the buffer changes.
+ */
+static void scene_buffer_set_texture_displayed(
+		struct wlr_scene_buffer *scene_buffer, bool displayed) {
+	if (scene_buffer->texture_cache_displayed == displayed) {
+		return;
+	}
+
+	struct wlr_scene *scene = scene_node_get_root(&scene_buffer->node);
+	struct wlr_client_buffer *client_buffer = scene_buffer->buffer != NULL ?
+		wlr_client_buffer_get(scene_buffer->buffer) : NULL;
+	if (scene->texture_cache == NULL || client_buffer == NULL ||
+			client_buffer->texture_cache != scene->texture_cache) {
+		// The cache has been destroyed or doesn't track the buffer
+		scene_buffer->texture_cache_displayed = false;
+		return;
+	}
+
+	scene_buffer->texture_cache_displayed = displayed;
+	wlr_texture_cache_set_displayed(scene->texture_cache, client_buffer,
+		displayed);
+}
+
+static bool scene_buffer_is_displayed(struct wlr_scene_buffer *scene_buffer) {
+	// Disabled nodes keep their last active outputs
+	int x, y;
+	return scene_buffer->active_outputs != 0 &&
+		wlr_scene_node_coords(&scene_buffer->node, &x, &y);
+}
+
+static void scene_node_update_texture_displayed(struct wlr_scene_node *node) {
+	if (node->type == WLR_SCENE_NODE_TREE) {
+		struct wlr_scene_tree *scene_tree = scene_tree_from_node(node);
+		struct wlr_scene_node *child;
+		wl_list_for_each(child, &scene_tree->children, link) {
+			scene_node_update_texture_displayed(child);
+		}
+	} else if (node->type == WLR_SCENE_NODE_BUFFER) {
+		struct wlr_scene_buffer *scene_buffer =
+			wlr_scene_buffer_from_node(node);
+		scene_buffer_set_texture_displayed(scene_buffer,
+			scene_buffer_is_displayed(scene_buffer));
+	}
+}
+
 struct highlight_region {
 	pixman_region32_t region;
 	struct timespec when;
@@ -94,6 +157,14 @@ void wlr_scene_node_destroy(struct wlr_scene_node *node) {
 	wlr_scene_node_set_enabled(node, false);
 
 	struct wlr_scene *scene = scene_node_get_root(node);
+	if (node->type != WLR_SCENE_NODE_TREE) {
+		// Make sure no render list keeps a reference to this node
+		struct wlr_scene_output *scene_output;
+		wl_list_for_each(scene_output, &scene->outputs, link) {
+			scene_output->render_list_dirty = true;
+		}
+	}
+
 	if (node->type == WLR_SCENE_NODE_BUFFER) {
 		struct wlr_scene_buffer *scene_buffer = wlr_scene_buffer_from_node(node);
 
@@ -109,6 +180,7 @@ void wlr_scene_node_destroy(struct wlr_scene_node *node) {
 		}
 
 		wlr_texture_destroy(scene_buffer->texture);
+		scene_buffer_set_texture_displayed(scene_buffer, false);
 		wlr_buffer_unlock(scene_buffer->buffer);
 		pixman_region32_fini(&scene_buffer->opaque_region);
 	} else if (node->type == WLR_SCENE_NODE_TREE) {
@@ -123,6 +195,8 @@ void wlr_scene_node_destroy(struct wlr_scene_node *node) {
 
 			wl_list_remove(&scene->presentation_destroy.link);
 			wl_list_remove(&scene->linux_dmabuf_v1_destroy.link);
+			wl_list_remove(&scene->texture_cache_destroy.link);
+			pixman_region32_fini(&scene->transaction_update_region);
 		} else {
 			assert(node->parent);
 		}
@@ -157,6 +231,8 @@ struct wlr_scene *wlr_scene_create(void) {
 	wl_list_init(&scene->outputs);
 	wl_list_init(&scene->presentation_destroy.link);
 	wl_list_init(&scene->linux_dmabuf_v1_destroy.link);
+	wl_list_init(&scene->texture_cache_destroy.link);
+	pixman_region32_init(&scene->transaction_update_region);
 
 	const char *debug_damage_options[] = {
 		"none",
@@ -186,6 +262,64 @@ struct wlr_scene_tree *wlr_scene_tree_create(struct wlr_scene_tree *parent) {
 
 static void scene_node_get_size(struct wlr_scene_node *node, int *lx, int *ly);
 
+static const struct wlr_box *scene_tree_get_bounds(struct wlr_scene_tree *tree);
+
+/**
+ * Get the box covered by the node and its enabled descendants, relative to
+ * the node's parent.
+ */
+static void scene_node_get_bounds(struct wlr_scene_node *node,
+		struct wlr_box *box) {
+	if (node->type == WLR_SCENE_NODE_TREE) {
+		*box = *scene_tree_get_bounds(scene_tree_from_node(node));
+	} else {
+		*box = (struct wlr_box){0};
+		scene_node_get_size(node, &box->width, &box->height);
+	}
+
+	box->x += node->x;
+	box->y += node->y;
+}
+
+static const struct wlr_box *scene_tree_get_bounds(struct wlr_scene_tree *tree) {
+	if (!tree->bounds_dirty) {
+		return &tree->bounds;
+	}
+
+	int x1 = INT_MAX, y1 = INT_MAX, x2 = INT_MIN, y2 = INT_MIN;
+	struct wlr_scene_node *child;
+	wl_list_for_each(child, &tree->children, link) {
+		if (!child->enabled) {
+			continue;
+		}
+
+		struct wlr_box box;
+		scene_node_get_bounds(child, &box);
+		if (wlr_box_empty(&box)) {
+			continue;
+		}
+
+		x1 = box.x < x1 ? box.x : x1;
+		y1 = box.y < y1 ? box.y : y1;
+		x2 = box.x + box.width > x2 ? box.x + box.width : x2;
+		y2 = box.y + box.height > y2 ? box.y + box.height : y2;
+	}
+
+	if (x1 < x2 && y1 < y2) {
+		tree->bounds = (struct wlr_box){
+			.x = x1,
+			.y = y1,
+			.width = x2 - x1,
+			.height = y2 - y1,
+		};
+	} else {
+		tree->bounds = (struct wlr_box){0};
+	}
+
+	tree->bounds_dirty = false;
+	return &tree->bounds;
+}
+
 typedef bool (*scene_node_box_iterator_func_t)(struct wlr_scene_node *node,
 	int sx, int sy, void *data);
 
@@ -198,6 +332,15 @@ static bool _scene_nodes_in_box(struct wlr_scene_node *node, struct wlr_box *box
 	switch (node->type) {
 	case WLR_SCENE_NODE_TREE:;
 		struct wlr_scene_tree *scene_tree = scene_tree_from_node(node);
+
+		// Skip the whole sub-tree if none of its descendants can intersect
+		struct wlr_box bounds = *scene_tree_get_bounds(scene_tree);
+		bounds.x += lx;
+		bounds.y += ly;
+		if (!wlr_box_intersection(&bounds, &bounds, box)) {
+			break;
+		}
+
 		struct wlr_scene_node *child;
 		wl_list_for_each_reverse(child, &scene_tree->children, link) {
 			if (_scene_nodes_in_box(child, box, iterator, user_data, lx + child->x, ly + child->y)) {
@@ -242,7 +385,9 @@ static void scene_node_opaque_region(struct wlr_scene_node *node, int x, int y,
 			return;
 		}
 
-		if (!buffer_is_opaque(scene_buffer->buffer)) {
+		bool opaque_solid = scene_buffer->solid &&
+			scene_buffer->solid_color[3] == 1;
+		if (!opaque_solid && !buffer_is_opaque(scene_buffer->buffer)) {
 			pixman_region32_copy(opaque, &scene_buffer->opaque_region);
 			pixman_region32_translate(opaque, x, y);
 			return;
@@ -262,24 +407,86 @@ struct scene_update_data {
 	bool calculate_visibility;
 };
 
-static uint32_t region_area(pixman_region32_t *region) {
-	uint32_t area = 0;
+static uint64_t region_area(const pixman_region32_t *region) {
+	uint64_t area = 0;
 
 	int nrects;
-	pixman_box32_t *rects = pixman_region32_rectangles(region, &nrects);
+	const pixman_box32_t *rects = pixman_region32_rectangles(region, &nrects);
 	for (int i = 0; i < nrects; ++i) {
-		area += (rects[i].x2 - rects[i].x1) * (rects[i].y2 - rects[i].y1);
+		area += (uint64_t)(rects[i].x2 - rects[i].x1) * (rects[i].y2 - rects[i].y1);
 	}
 
 	return area;
 }
 
+/**
+ * Scale a damage region to output-buffer coordinates. Rectangle edges which
+ * don't land on a pixel boundary are pushed out by one more pixel, to account
+ * for the partially covered pixel bleeding into its neighbour. Edges which
+ * scale to an integer coordinate are left as-is.
+ */
 static void scale_output_damage(pixman_region32_t *damage, float scale) {
-	wlr_region_scale(damage, damage, scale);
+	if (scale == 1.0) {
+		return;
+	}
+
+	int nrects;
+	const pixman_box32_t *src_rects = pixman_region32_rectangles(damage, &nrects);
+
+	pixman_box32_t *dst_rects = malloc(nrects * sizeof(pixman_box32_t));
+	if (dst_rects == NULL) {
+		return;
+	}
+
+	for (int i = 0; i < nrects; ++i) {
+		double x1 = src_rects[i].x1 * scale, y1 = src_rects[i].y1 * scale;
+		double x2 = src_rects[i].x2 * scale, y2 = src_rects[i].y2 * scale;
+		dst_rects[i].x1 = floor(x1) != x1 ? floor(x1) - 1 : x1;
+		dst_rects[i].y1 = floor(y1) != y1 ? floor(y1) - 1 : y1;
+		dst_rects[i].x2 = ceil(x2) != x2 ? ceil(x2) + 1 : x2;
+		dst_rects[i].y2 = ceil(y2) != y2 ? ceil(y2) + 1 : y2;
+	}
+
+	pixman_region32_fini(damage);
+	pixman_region32_init_rects(damage, dst_rects, nrects);
+	free(dst_rects);
+}
 
-	if (floor(scale) != scale) {
-		wlr_region_expand(damage, damage, 1);
+/**
+ * Scale an opaque region to output-buffer coordinates. Unlike damage, opaque
+ * regions are rounded inwards, so that pixels which are only partially covered
+ * are never considered opaque.
+ */
+static void scale_opaque_region(pixman_region32_t *opaque, float scale) {
+	if (scale == 1.0) {
+		return;
+	}
+
+	int nrects;
+	const pixman_box32_t *src_rects = pixman_region32_rectangles(opaque, &nrects);
+
+	pixman_box32_t *dst_rects = malloc(nrects * sizeof(pixman_box32_t));
+	if (dst_rects == NULL) {
+		pixman_region32_clear(opaque);
+		return;
+	}
+
+	int n = 0;
+	for (int i = 0; i < nrects; ++i) {
+		pixman_box32_t box = {
+			.x1 = ceil(src_rects[i].x1 * scale),
+			.y1 = ceil(src_rects[i].y1 * scale),
+			.x2 = floor(src_rects[i].x2 * scale),
+			.y2 = floor(src_rects[i].y2 * scale),
+		};
+		if (box.x1 < box.x2 && box.y1 < box.y2) {
+			dst_rects[n++] = box;
+		}
 	}
+
+	pixman_region32_fini(opaque);
+	pixman_region32_init_rects(opaque, dst_rects, n);
+	free(dst_rects);
 }
 
 static void transform_output_damage(pixman_region32_t *damage, struct wlr_output *output) {
@@ -383,6 +590,11 @@ static void update_node_update_outputs(struct wlr_scene_node *node,
 	uint64_t old_active = scene_buffer->active_outputs;
 	scene_buffer->active_outputs = active_outputs;
 
+	if ((old_active != 0) != (active_outputs != 0)) {
+		scene_buffer_set_texture_displayed(scene_buffer,
+			scene_buffer_is_displayed(scene_buffer));
+	}
+
 	wl_list_for_each(scene_output, outputs, link) {
 		uint64_t mask = 1ull << scene_output->index;
 		bool intersects = active_outputs & mask;
@@ -510,6 +722,22 @@ static void scene_update_region(struct wlr_scene *scene,
 	// update node visibility and output enter/leave events
 	scene_nodes_in_box(&scene->tree.node, &box, scene_node_update_iterator, &data);
 
+	// the render list of any output overlapping the updated region may
+	// have changed
+	struct wlr_scene_output *scene_output;
+	wl_list_for_each(scene_output, &scene->outputs, link) {
+		struct wlr_box output_box = {
+			.x = scene_output->x,
+			.y = scene_output->y,
+		};
+		wlr_output_effective_resolution(scene_output->output,
+			&output_box.width, &output_box.height);
+
+		if (wlr_box_intersection(&output_box, &output_box, &box)) {
+			scene_output->render_list_dirty = true;
+		}
+	}
+
 	pixman_region32_fini(&visible);
 }
 
@@ -520,8 +748,13 @@ static void scene_node_update(struct wlr_scene_node *node,
 	int x, y;
 	if (!wlr_scene_node_coords(node, &x, &y)) {
 		if (damage) {
-			scene_update_region(scene, damage);
-			scene_damage_outputs(scene, damage);
+			if (scene->transaction_depth > 0) {
+				pixman_region32_union(&scene->transaction_update_region,
+					&scene->transaction_update_region, damage);
+			} else {
+				scene_update_region(scene, damage);
+				scene_damage_outputs(scene, damage);
+			}
 			pixman_region32_fini(damage);
 		}
 
@@ -540,6 +773,16 @@ static void scene_node_update(struct wlr_scene_node *node,
 	pixman_region32_copy(&update_region, damage);
 	scene_node_bounds(node, x, y, &update_region);
 
+	if (scene->transaction_depth > 0) {
+		// The node's new visibility isn't known until the transaction is
+		// committed, so the whole update region will be damaged then
+		pixman_region32_union(&scene->transaction_update_region,
+			&scene->transaction_update_region, &update_region);
+		pixman_region32_fini(&update_region);
+		pixman_region32_fini(damage);
+		return;
+	}
+
 	scene_update_region(scene, &update_region);
 	pixman_region32_fini(&update_region);
 
@@ -548,6 +791,28 @@ static void scene_node_update(struct wlr_scene_node *node,
 	pixman_region32_fini(damage);
 }
 
+void wlr_scene_begin_transaction(struct wlr_scene *scene) {
+	scene->transaction_depth++;
+}
+
+void wlr_scene_commit_transaction(struct wlr_scene *scene) {
+	assert(scene->transaction_depth > 0);
+	if (--scene->transaction_depth > 0) {
+		return;
+	}
+
+	// Take ownership of the accumulated region: signal handlers invoked
+	// while updating may start a new transaction.
+	pixman_region32_t update_region;
+	pixman_region32_init(&update_region);
+	pixman_region32_copy(&update_region, &scene->transaction_update_region);
+	pixman_region32_clear(&scene->transaction_update_region);
+
+	scene_update_region(scene, &update_region);
+	scene_damage_outputs(scene, &update_region);
+	pixman_region32_fini(&update_region);
+}
+
 struct wlr_scene_rect *wlr_scene_rect_create(struct wlr_scene_tree *parent,
 		int width, int height, const float color[static 4]) {
 	struct wlr_scene_rect *scene_rect =
@@ -574,6 +839,7 @@ void wlr_scene_rect_set_size(struct wlr_scene_rect *rect, int width, int height)
 
 	rect->width = width;
 	rect->height = height;
+	scene_node_invalidate_bounds(&rect->node);
 	scene_node_update(&rect->node, NULL);
 }
 
@@ -611,6 +877,27 @@ struct wlr_scene_buffer *wlr_scene_buffer_create(struct wlr_scene_tree *parent,
 	return scene_buffer;
 }
 
+static void scene_buffer_update_solid(struct wlr_scene_buffer *scene_buffer) {
+	struct wlr_buffer *buffer = scene_buffer->buffer;
+	if (buffer == NULL) {
+		scene_buffer->solid = false;
+		return;
+	}
+
+	// Client buffers have already been read on commit, their source may
+	// have been released since
+	struct wlr_client_buffer *client_buffer = wlr_client_buffer_get(buffer);
+	if (client_buffer != NULL) {
+		scene_buffer->solid = client_buffer->solid;
+		memcpy(scene_buffer->solid_color, client_buffer->solid_color,
+			sizeof(scene_buffer->solid_color));
+		return;
+	}
+
+	scene_buffer->solid = buffer_get_solid_color(buffer,
+		scene_buffer->solid_color);
+}
+
 void wlr_scene_buffer_set_buffer_with_damage(struct wlr_scene_buffer *scene_buffer,
 		struct wlr_buffer *buffer, const pixman_region32_t *damage) {
 	// specifying a region for a NULL buffer doesn't make sense. We need to know
@@ -623,6 +910,8 @@ void wlr_scene_buffer_set_buffer_with_damage(struct wlr_scene_buffer *scene_buff
 	wlr_texture_destroy(scene_buffer->texture);
 	scene_buffer->texture = NULL;
 
+	scene_buffer_set_texture_displayed(scene_buffer, false);
+
 	if (buffer) {
 		// if this node used to not be mapped or its previous displayed
 		// buffer region will be different from what the new buffer would
@@ -640,7 +929,26 @@ void wlr_scene_buffer_set_buffer_with_damage(struct wlr_scene_buffer *scene_buff
 		scene_buffer->buffer = NULL;
 	}
 
+	struct wlr_scene *scene = scene_node_get_root(&scene_buffer->node);
+	struct wlr_client_buffer *client_buffer =
+		buffer != NULL ? wlr_client_buffer_get(buffer) : NULL;
+	if (scene->texture_cache != NULL && client_buffer != NULL) {
+		wlr_texture_cache_add(scene->texture_cache, client_buffer);
+		scene_buffer_set_texture_displayed(scene_buffer,
+			scene_buffer_is_displayed(scene_buffer));
+	}
+
+	bool was_opaque_solid = scene_buffer->solid &&
+		scene_buffer->solid_color[3] == 1;
+	scene_buffer_update_solid(scene_buffer);
+	if (was_opaque_solid != (scene_buffer->solid &&
+			scene_buffer->solid_color[3] == 1)) {
+		// The opaque region changed, visibility needs to be recomputed
+		update = true;
+	}
+
 	if (update) {
+		scene_node_invalidate_bounds(&scene_buffer->node);
 		scene_node_update(&scene_buffer->node, NULL);
 		// updating the node will already damage the whole node for us. Return
 		// early to not damage again
@@ -686,7 +994,6 @@ void wlr_scene_buffer_set_buffer_with_damage(struct wlr_scene_buffer *scene_buff
 		box.x, box.y, box.width, box.height);
 	pixman_region32_translate(&trans_damage, -box.x, -box.y);
 
-	struct wlr_scene *scene = scene_node_get_root(&scene_buffer->node);
 	struct wlr_scene_output *scene_output;
 	wl_list_for_each(scene_output, &scene->outputs, link) {
 		float output_scale = scene_output->output->scale;
@@ -712,9 +1019,7 @@ void wlr_scene_buffer_set_buffer_with_damage(struct wlr_scene_buffer *scene_buff
 			(int)ceilf(output_scale_x / 2.0f) : 0;
 		int dist_y = floor(buffer_scale_y) != buffer_scale_y ?
 			(int)ceilf(output_scale_y / 2.0f) : 0;
-		// TODO: expand with per-axis distances
-		wlr_region_expand(&output_damage, &output_damage,
-			dist_x >= dist_y ? dist_x : dist_y);
+		wlr_region_expand_xy(&output_damage, &output_damage, dist_x, dist_y);
 
 		pixman_region32_t cull_region;
 		pixman_region32_init(&cull_region);
@@ -775,6 +1080,7 @@ void wlr_scene_buffer_set_dest_size(struct wlr_scene_buffer *scene_buffer,
 
 	scene_buffer->dst_width = width;
 	scene_buffer->dst_height = height;
+	scene_node_invalidate_bounds(&scene_buffer->node);
 	scene_node_update(&scene_buffer->node, NULL);
 }
 
@@ -785,6 +1091,7 @@ void wlr_scene_buffer_set_transform(struct wlr_scene_buffer *scene_buffer,
 	}
 
 	scene_buffer->transform = transform;
+	scene_node_invalidate_bounds(&scene_buffer->node);
 	scene_node_update(&scene_buffer->node, NULL);
 }
 
@@ -800,7 +1107,7 @@ static struct wlr_texture *scene_buffer_get_texture(
 	struct wlr_client_buffer *client_buffer =
 		wlr_client_buffer_get(scene_buffer->buffer);
 	if (client_buffer != NULL) {
-		return client_buffer->texture;
+		return wlr_client_buffer_get_texture(client_buffer);
 	}
 
 	if (scene_buffer->texture != NULL) {
@@ -867,8 +1174,12 @@ void wlr_scene_node_set_enabled(struct wlr_scene_node *node, bool enabled) {
 	}
 
 	node->enabled = enabled;
+	scene_node_invalidate_bounds(node);
 
 	scene_node_update(node, &visible);
+
+	// Hidden buffers may be evicted from the texture cache
+	scene_node_update_texture_displayed(node);
 }
 
 void wlr_scene_node_set_position(struct wlr_scene_node *node, int x, int y) {
@@ -878,6 +1189,7 @@ void wlr_scene_node_set_position(struct wlr_scene_node *node, int x, int y) {
 
 	node->x = x;
 	node->y = y;
+	scene_node_invalidate_bounds(node);
 	scene_node_update(node, NULL);
 }
 
@@ -948,9 +1260,11 @@ void wlr_scene_node_reparent(struct wlr_scene_node *node,
 		scene_node_visibility(node, &visible);
 	}
 
+	scene_node_invalidate_bounds(node);
 	wl_list_remove(&node->link);
 	node->parent = new_parent;
 	wl_list_insert(new_parent->children.prev, &node->link);
+	scene_node_invalidate_bounds(node);
 	scene_node_update(node, &visible);
 }
 
@@ -1058,9 +1372,18 @@ struct wlr_scene_node *wlr_scene_node_at(struct wlr_scene_node *node,
 	return NULL;
 }
 
+/**
+ * Render a node, clipped to render_region. The region is in output-buffer
+ * local coordinates, before the output transform is applied. It is modified
+ * by this function.
+ */
 static void scene_node_render(struct wlr_scene_node *node,
 		struct wlr_scene_output *scene_output, struct wlr_render_pass *render_pass,
-		pixman_region32_t *damage) {
+		pixman_region32_t *render_region) {
+	if (!pixman_region32_not_empty(render_region)) {
+		return;
+	}
+
 	int x, y;
 	wlr_scene_node_coords(node, &x, &y);
 	x -= scene_output->x;
@@ -1068,17 +1391,6 @@ static void scene_node_render(struct wlr_scene_node *node,
 
 	struct wlr_output *output = scene_output->output;
 
-	pixman_region32_t render_region;
-	pixman_region32_init(&render_region);
-	pixman_region32_copy(&render_region, &node->visible);
-	pixman_region32_translate(&render_region, -scene_output->x, -scene_output->y);
-	scale_output_damage(&render_region, output->scale);
-	pixman_region32_intersect(&render_region, &render_region, damage);
-	if (!pixman_region32_not_empty(&render_region)) {
-		pixman_region32_fini(&render_region);
-		return;
-	}
-
 	struct wlr_box dst_box = {
 		.x = x,
 		.y = y,
@@ -1087,7 +1399,7 @@ static void scene_node_render(struct wlr_scene_node *node,
 	scale_box(&dst_box, output->scale);
 
 	transform_output_box(&dst_box, output);
-	transform_output_damage(&render_region, output);
+	transform_output_damage(render_region, output);
 
 	struct wlr_texture *texture;
 	enum wl_output_transform transform;
@@ -1106,13 +1418,30 @@ static void scene_node_render(struct wlr_scene_node *node,
 				.b = scene_rect->color[2],
 				.a = scene_rect->color[3],
 			},
-			.clip = &render_region,
+			.clip = render_region,
 		});
 		break;
 	case WLR_SCENE_NODE_BUFFER:;
 		struct wlr_scene_buffer *scene_buffer = wlr_scene_buffer_from_node(node);
 		assert(scene_buffer->buffer);
 
+		if (scene_buffer->solid) {
+			// Cropping and transforms don't matter for a single color
+			wlr_render_pass_add_rect(render_pass, &(struct wlr_render_rect_options){
+				.box = dst_box,
+				.color = {
+					.r = scene_buffer->solid_color[0],
+					.g = scene_buffer->solid_color[1],
+					.b = scene_buffer->solid_color[2],
+					.a = scene_buffer->solid_color[3],
+				},
+				.clip = render_region,
+			});
+
+			wl_signal_emit_mutable(&scene_buffer->events.output_present, scene_output);
+			break;
+		}
+
 		struct wlr_renderer *renderer = output->renderer;
 		texture = scene_buffer_get_texture(scene_buffer, renderer);
 		if (texture == NULL) {
@@ -1127,14 +1456,13 @@ static void scene_node_render(struct wlr_scene_node *node,
 			.src_box = scene_buffer->src_box,
 			.dst_box = dst_box,
 			.transform = transform,
-			.clip = &render_region,
+			.clip = render_region,
 		});
 
 		wl_signal_emit_mutable(&scene_buffer->events.output_present, scene_output);
 		break;
 	}
 
-	pixman_region32_fini(&render_region);
 }
 
 static void scene_handle_presentation_destroy(struct wl_listener *listener,
@@ -1171,6 +1499,23 @@ void wlr_scene_set_linux_dmabuf_v1(struct wlr_scene *scene,
 	wl_signal_add(&linux_dmabuf_v1->events.destroy, &scene->linux_dmabuf_v1_destroy);
 }
 
+static void scene_handle_texture_cache_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_scene *scene =
+		wl_container_of(listener, scene, texture_cache_destroy);
+	wl_list_remove(&scene->texture_cache_destroy.link);
+	wl_list_init(&scene->texture_cache_destroy.link);
+	scene->texture_cache = NULL;
+}
+
+void wlr_scene_set_texture_cache(struct wlr_scene *scene,
+		struct wlr_texture_cache *cache) {
+	assert(scene->texture_cache == NULL);
+	scene->texture_cache = cache;
+	scene->texture_cache_destroy.notify = scene_handle_texture_cache_destroy;
+	wl_signal_add(&cache->events.destroy, &scene->texture_cache_destroy);
+}
+
 static void scene_output_handle_destroy(struct wlr_addon *addon) {
 	struct wlr_scene_output *scene_output =
 		wl_container_of(addon, scene_output, addon);
@@ -1201,6 +1546,7 @@ static void scene_output_update_geometry(struct wlr_scene_output *scene_output)
 	wlr_output_transformed_resolution(scene_output->output, &width, &height);
 	wlr_damage_ring_set_bounds(&scene_output->damage_ring, width, height);
 	wlr_output_schedule_frame(scene_output->output);
+	scene_output->render_list_dirty = true;
 
 	scene_node_output_update(&scene_output->scene->tree.node,
 			&scene_output->scene->outputs, NULL);
@@ -1276,6 +1622,8 @@ struct wlr_scene_output *wlr_scene_output_create(struct wlr_scene *scene,
 	scene_output->output_needs_frame.notify = scene_output_handle_needs_frame;
 	wl_signal_add(&output->events.needs_frame, &scene_output->output_needs_frame);
 
+	wl_list_init(&scene_output->recording_destroy.link);
+
 	scene_output_update_geometry(scene_output);
 
 	return scene_output;
@@ -1308,11 +1656,31 @@ void wlr_scene_output_destroy(struct wlr_scene_output *scene_output) {
 	wl_list_remove(&scene_output->output_commit.link);
 	wl_list_remove(&scene_output->output_damage.link);
 	wl_list_remove(&scene_output->output_needs_frame.link);
+	wl_list_remove(&scene_output->recording_destroy.link);
 
 	wl_array_release(&scene_output->render_list);
 	free(scene_output);
 }
 
+static void scene_output_handle_recording_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_scene_output *scene_output =
+		wl_container_of(listener, scene_output, recording_destroy);
+	wlr_scene_output_set_recording(scene_output, NULL);
+}
+
+void wlr_scene_output_set_recording(struct wlr_scene_output *scene_output,
+		struct wlr_render_recording *recording) {
+	wl_list_remove(&scene_output->recording_destroy.link);
+	wl_list_init(&scene_output->recording_destroy.link);
+	scene_output->recording = recording;
+
+	if (recording != NULL) {
+		scene_output->recording_destroy.notify = scene_output_handle_recording_destroy;
+		wl_signal_add(&recording->events.destroy, &scene_output->recording_destroy);
+	}
+}
+
 struct wlr_scene_output *wlr_scene_get_scene_output(struct wlr_scene *scene,
 		struct wlr_output *output) {
 	struct wlr_addon *addon =
@@ -1445,27 +1813,56 @@ static void scene_buffer_send_dmabuf_feedback(const struct wlr_scene *scene,
 	wlr_linux_dmabuf_feedback_v1_finish(&feedback);
 }
 
-static bool scene_buffer_can_consider_direct_scanout(struct wlr_scene_buffer *buffer,
-		const struct wlr_scene_output *scene_output) {
+const char *wlr_scene_direct_scanout_result_str(
+		enum wlr_scene_direct_scanout_result result) {
+	switch (result) {
+	case WLR_SCENE_DIRECT_SCANOUT_SUCCESS:
+		return "success";
+	case WLR_SCENE_DIRECT_SCANOUT_DISABLED:
+		return "disabled";
+	case WLR_SCENE_DIRECT_SCANOUT_DEBUG_DAMAGE:
+		return "damage highlighting is enabled";
+	case WLR_SCENE_DIRECT_SCANOUT_NODE_COUNT:
+		return "not exactly one node to render";
+	case WLR_SCENE_DIRECT_SCANOUT_NOT_BUFFER:
+		return "node is not a buffer";
+	case WLR_SCENE_DIRECT_SCANOUT_OUTPUT_DISALLOWED:
+		return "not allowed by output";
+	case WLR_SCENE_DIRECT_SCANOUT_SRC_BOX:
+		return "buffer is cropped";
+	case WLR_SCENE_DIRECT_SCANOUT_TRANSFORM:
+		return "buffer transform doesn't match output";
+	case WLR_SCENE_DIRECT_SCANOUT_GEOMETRY:
+		return "buffer doesn't cover the output";
+	case WLR_SCENE_DIRECT_SCANOUT_TEST_FAILED:
+		return "buffer rejected by backend";
+	case WLR_SCENE_DIRECT_SCANOUT_COMMIT_FAILED:
+		return "output commit failed";
+	}
+	return "unknown";
+}
+
+static enum wlr_scene_direct_scanout_result scene_buffer_can_consider_direct_scanout(
+		struct wlr_scene_buffer *buffer, const struct wlr_scene_output *scene_output) {
 	struct wlr_scene_node *node = &buffer->node;
 
 	if (!scene_output->scene->direct_scanout) {
-		return false;
+		return WLR_SCENE_DIRECT_SCANOUT_DISABLED;
 	}
 
 	if (scene_output->scene->debug_damage_option ==
 			WLR_SCENE_DEBUG_DAMAGE_HIGHLIGHT) {
 		// We don't want to enter direct scan out if we have highlight regions
 		// enabled. Otherwise, we won't be able to render the damage regions.
-		return false;
+		return WLR_SCENE_DIRECT_SCANOUT_DEBUG_DAMAGE;
 	}
 
 	if (node->type != WLR_SCENE_NODE_BUFFER) {
-		return false;
+		return WLR_SCENE_DIRECT_SCANOUT_NOT_BUFFER;
 	}
 
 	if (!wlr_output_is_direct_scanout_allowed(scene_output->output)) {
-		return false;
+		return WLR_SCENE_DIRECT_SCANOUT_OUTPUT_DISALLOWED;
 	}
 
 	struct wlr_fbox default_box = {0};
@@ -1479,11 +1876,11 @@ static bool scene_buffer_can_consider_direct_scanout(struct wlr_scene_buffer *bu
 
 	if (!wlr_fbox_empty(&buffer->src_box) &&
 			!wlr_fbox_equal(&buffer->src_box, &default_box)) {
-		return false;
+		return WLR_SCENE_DIRECT_SCANOUT_SRC_BOX;
 	}
 
 	if (buffer->transform != scene_output->output->transform) {
-		return false;
+		return WLR_SCENE_DIRECT_SCANOUT_TRANSFORM;
 	}
 
 	struct wlr_box node_box;
@@ -1498,21 +1895,21 @@ static bool scene_buffer_can_consider_direct_scanout(struct wlr_scene_buffer *bu
 	wlr_output_effective_resolution(scene_output->output, &box.width, &box.height);
 
 	if (!wlr_box_equal(&box, &node_box)) {
-		return false;
+		return WLR_SCENE_DIRECT_SCANOUT_GEOMETRY;
 	}
 
-	return true;
+	return WLR_SCENE_DIRECT_SCANOUT_SUCCESS;
 }
 
-static bool scene_buffer_try_direct_scanout(struct wlr_scene_buffer *buffer,
-		struct wlr_scene_output *scene_output) {
+static enum wlr_scene_direct_scanout_result scene_buffer_try_direct_scanout(
+		struct wlr_scene_buffer *buffer, struct wlr_scene_output *scene_output) {
 	struct wlr_output_state state = {
 		.committed = WLR_OUTPUT_STATE_BUFFER,
 		.buffer = buffer->buffer,
 	};
 
 	if (!wlr_output_test_state(scene_output->output, &state)) {
-		return false;
+		return WLR_SCENE_DIRECT_SCANOUT_TEST_FAILED;
 	}
 
 	wl_signal_emit_mutable(&buffer->events.output_present, scene_output);
@@ -1522,12 +1919,27 @@ static bool scene_buffer_try_direct_scanout(struct wlr_scene_buffer *buffer,
 	bool ok = wlr_output_commit_state(scene_output->output, &state);
 	pixman_region32_fini(&state.damage);
 	if (!ok) {
-		return false;
+		return WLR_SCENE_DIRECT_SCANOUT_COMMIT_FAILED;
 	}
 
 	wlr_damage_ring_rotate(&scene_output->damage_ring);
 
-	return true;
+	return WLR_SCENE_DIRECT_SCANOUT_SUCCESS;
+}
+
+
+static void scene_output_update_texture_cache(
+		struct wlr_scene_output *scene_output) {
+	struct wlr_scene *scene = scene_output->scene;
+
+	// Outputs may refresh at different rates: end the cache frame when an
+	// output renders a second time in it, so that it ends once per round of
+	// output frames
+	if (scene_output->texture_cache_frame == scene->texture_cache_frame) {
+		wlr_texture_cache_end_frame(scene->texture_cache);
+		scene->texture_cache_frame++;
+	}
+	scene_output->texture_cache_frame = scene->texture_cache_frame;
 }
 
 bool wlr_scene_output_commit(struct wlr_scene_output *scene_output) {
@@ -1538,39 +1950,68 @@ bool wlr_scene_output_commit(struct wlr_scene_output *scene_output) {
 	struct wlr_renderer *renderer = output->renderer;
 	assert(renderer != NULL);
 
+	// Visibility isn't up to date while a transaction is open
+	assert(scene_output->scene->transaction_depth == 0);
+
 	if (!output->needs_frame && !pixman_region32_not_empty(
 			&scene_output->damage_ring.current)) {
 		return true;
 	}
 
-	struct render_list_constructor_data list_con = {
-		.box = { .x = scene_output->x, .y = scene_output->y },
-		.render_list = &scene_output->render_list,
-		.calculate_visibility = scene_output->scene->calculate_visibility,
-	};
-	wlr_output_effective_resolution(output,
-		&list_con.box.width, &list_con.box.height);
+	if (scene_output->scene->texture_cache != NULL) {
+		scene_output_update_texture_cache(scene_output);
+	}
+
+	// The render list only depends on the scene structure and node
+	// visibility, so it can be re-used as long as only buffer contents
+	// have been damaged.
+	if (scene_output->render_list_dirty) {
+		struct render_list_constructor_data list_con = {
+			.box = { .x = scene_output->x, .y = scene_output->y },
+			.render_list = &scene_output->render_list,
+			.calculate_visibility = scene_output->scene->calculate_visibility,
+		};
+		wlr_output_effective_resolution(output,
+			&list_con.box.width, &list_con.box.height);
 
-	list_con.render_list->size = 0;
-	scene_nodes_in_box(&scene_output->scene->tree.node, &list_con.box,
-		construct_render_list_iterator, &list_con);
-	array_realloc(list_con.render_list, list_con.render_list->size);
+		list_con.render_list->size = 0;
+		scene_nodes_in_box(&scene_output->scene->tree.node, &list_con.box,
+			construct_render_list_iterator, &list_con);
+		array_realloc(list_con.render_list, list_con.render_list->size);
 
-	int list_len = list_con.render_list->size / sizeof(struct wlr_scene_node *);
-	struct wlr_scene_node **list_data = list_con.render_list->data;
+		scene_output->render_list_dirty = false;
+	}
+
+	int list_len = scene_output->render_list.size / sizeof(struct wlr_scene_node *);
+	struct wlr_scene_node **list_data = scene_output->render_list.data;
 
 	bool sent_direct_scanout_feedback = false;
 
+	struct wlr_scene_output_frame_stats stats = {
+		.render_list_len = list_len,
+		.output_area = (uint64_t)output->width * output->height,
+		.direct_scanout = WLR_SCENE_DIRECT_SCANOUT_NODE_COUNT,
+	};
+
+	// Report why direct scan-out is skipped before looking at the nodes
+	if (!scene_output->scene->direct_scanout) {
+		stats.direct_scanout = WLR_SCENE_DIRECT_SCANOUT_DISABLED;
+	} else if (debug_damage == WLR_SCENE_DEBUG_DAMAGE_HIGHLIGHT) {
+		stats.direct_scanout = WLR_SCENE_DIRECT_SCANOUT_DEBUG_DAMAGE;
+	}
+
 	// if there is only one thing to render let's see if that thing can be
 	// directly scanned out
-	bool scanout = false;
-	if (list_len == 1) {
+	if (list_len == 1 &&
+			stats.direct_scanout == WLR_SCENE_DIRECT_SCANOUT_NODE_COUNT) {
 		struct wlr_scene_node *node = list_data[0];
 
 		if (node->type == WLR_SCENE_NODE_BUFFER) {
 			struct wlr_scene_buffer *buffer = wlr_scene_buffer_from_node(node);
 
-			if (scene_buffer_can_consider_direct_scanout(buffer, scene_output)) {
+			stats.direct_scanout =
+				scene_buffer_can_consider_direct_scanout(buffer, scene_output);
+			if (stats.direct_scanout == WLR_SCENE_DIRECT_SCANOUT_SUCCESS) {
 				if (buffer->primary_output == scene_output) {
 					struct wlr_linux_dmabuf_feedback_v1_init_options options = {
 						.main_renderer = output->renderer,
@@ -1581,22 +2022,30 @@ bool wlr_scene_output_commit(struct wlr_scene_output *scene_output) {
 					sent_direct_scanout_feedback = true;
 				}
 
-				scanout = scene_buffer_try_direct_scanout(buffer, scene_output);
+				stats.direct_scanout =
+					scene_buffer_try_direct_scanout(buffer, scene_output);
 			}
+		} else {
+			stats.direct_scanout = WLR_SCENE_DIRECT_SCANOUT_NOT_BUFFER;
 		}
 	}
 
+	bool scanout = stats.direct_scanout == WLR_SCENE_DIRECT_SCANOUT_SUCCESS;
 	if (scene_output->prev_scanout != scanout) {
 		scene_output->prev_scanout = scanout;
-		wlr_log(WLR_DEBUG, "Direct scan-out %s",
-			scanout ? "enabled" : "disabled");
-		if (!scanout) {
+		if (scanout) {
+			wlr_log(WLR_DEBUG, "Direct scan-out enabled");
+		} else {
+			wlr_log(WLR_DEBUG, "Direct scan-out disabled: %s",
+				wlr_scene_direct_scanout_result_str(stats.direct_scanout));
 			// When exiting direct scan-out, damage everything
 			wlr_damage_ring_add_whole(&scene_output->damage_ring);
 		}
 	}
 
 	if (scanout) {
+		stats.damage_area = stats.output_area;
+		scene_output->frame_stats = stats;
 		return true;
 	}
 
@@ -1657,14 +2106,82 @@ bool wlr_scene_output_commit(struct wlr_scene_output *scene_output) {
 	pixman_region32_init(&damage);
 	wlr_damage_ring_get_buffer_damage(&scene_output->damage_ring,
 		buffer_age, &damage);
+	stats.damage_area = region_area(&damage);
+
+	pixman_region32_t *render_regions = NULL;
+	if (list_len > 0) {
+		render_regions = calloc(list_len, sizeof(*render_regions));
+		if (render_regions == NULL) {
+			wlr_log(WLR_ERROR, "Allocation failed");
+			pixman_region32_fini(&damage);
+			wlr_buffer_unlock(buffer);
+			return false;
+		}
+	}
 
 	struct wlr_render_pass *render_pass = wlr_renderer_begin_buffer_pass(renderer, buffer);
 	if (render_pass == NULL) {
+		free(render_regions);
 		pixman_region32_fini(&damage);
 		wlr_buffer_unlock(buffer);
 		return false;
 	}
 
+	if (scene_output->recording != NULL) {
+		struct wlr_render_pass *recording_pass = wlr_render_recording_begin_pass(
+			scene_output->recording, render_pass, buffer->width, buffer->height);
+		if (recording_pass != NULL) {
+			render_pass = recording_pass;
+		} else {
+			wlr_log(WLR_ERROR, "Failed to begin render pass recording");
+		}
+	}
+
+	float output_scale = scene_output->output->scale;
+
+	// Walk the render list front to back, clipping each node by the opaque
+	// regions of the nodes above it. Node visibility already accounts for
+	// occlusion in layout coordinates, but with fractional scales the render
+	// regions are rounded outwards and overlap the nodes above.
+	pixman_region32_t opaque_above;
+	pixman_region32_init(&opaque_above);
+	for (int i = 0; i < list_len; i++) {
+		struct wlr_scene_node *node = list_data[i];
+		pixman_region32_t *render_region = &render_regions[i];
+
+		pixman_region32_init(render_region);
+		pixman_region32_copy(render_region, &node->visible);
+		pixman_region32_translate(render_region, -scene_output->x, -scene_output->y);
+		scale_output_damage(render_region, output_scale);
+		pixman_region32_intersect(render_region, render_region, &damage);
+
+		if (!scene_output->scene->calculate_visibility) {
+			continue;
+		}
+
+		uint64_t area = region_area(render_region);
+		pixman_region32_subtract(render_region, render_region, &opaque_above);
+		stats.pixels_culled += area - region_area(render_region);
+
+		int x, y;
+		wlr_scene_node_coords(node, &x, &y);
+
+		// We must only cull opaque regions that are visible by the node.
+		// The node's visibility will have the knowledge of a black rect
+		// that may have been omitted from the render list via the black
+		// rect optimization. In order to ensure we don't cull background
+		// rendering in that black rect region, consider the node's visibility.
+		pixman_region32_t opaque;
+		pixman_region32_init(&opaque);
+		scene_node_opaque_region(node, x, y, &opaque);
+		pixman_region32_intersect(&opaque, &opaque, &node->visible);
+
+		pixman_region32_translate(&opaque, -scene_output->x, -scene_output->y);
+		scale_opaque_region(&opaque, output_scale);
+		pixman_region32_union(&opaque_above, &opaque_above, &opaque);
+		pixman_region32_fini(&opaque);
+	}
+
 	pixman_region32_t background;
 	pixman_region32_init(&background);
 	pixman_region32_copy(&background, &damage);
@@ -1672,37 +2189,14 @@ bool wlr_scene_output_commit(struct wlr_scene_output *scene_output) {
 	// Cull areas of the background that are occluded by opaque regions of
 	// scene nodes above. Those scene nodes will just render atop having us
 	// never see the background.
-	if (scene_output->scene->calculate_visibility) {
-		float output_scale = scene_output->output->scale;
-
-		for (int i = list_len - 1; i >= 0; i--) {
-			struct wlr_scene_node *node = list_data[i];
-			int x, y;
-			wlr_scene_node_coords(node, &x, &y);
-
-			// We must only cull opaque regions that are visible by the node.
-			// The node's visibility will have the knowledge of a black rect
-			// that may have been omitted from the render list via the black
-			// rect optimization. In order to ensure we don't cull background
-			// rendering in that black rect region, consider the node's visibility.
-			pixman_region32_t opaque;
-			pixman_region32_init(&opaque);
-			scene_node_opaque_region(node, x, y, &opaque);
-			pixman_region32_intersect(&opaque, &opaque, &node->visible);
-
-			pixman_region32_translate(&opaque, -scene_output->x, -scene_output->y);
-			wlr_region_scale(&opaque, &opaque, output_scale);
-			pixman_region32_subtract(&background, &background, &opaque);
-			pixman_region32_fini(&opaque);
-		}
+	pixman_region32_subtract(&background, &background, &opaque_above);
+	pixman_region32_fini(&opaque_above);
 
-		if (floor(output_scale) != output_scale) {
-			wlr_region_expand(&background, &background, 1);
-
-			// reintersect with the damage because we never want to render
-			// outside of the damage region
-			pixman_region32_intersect(&background, &background, &damage);
-		}
+	uint64_t background_area = region_area(&background);
+	stats.pixels_culled += stats.damage_area - background_area;
+	if (background_area > 0) {
+		stats.ops_len++;
+		stats.pixels_written += background_area;
 	}
 
 	transform_output_damage(&background, output);
@@ -1715,7 +2209,13 @@ bool wlr_scene_output_commit(struct wlr_scene_output *scene_output) {
 
 	for (int i = list_len - 1; i >= 0; i--) {
 		struct wlr_scene_node *node = list_data[i];
-		scene_node_render(node, scene_output, render_pass, &damage);
+		uint64_t area = region_area(&render_regions[i]);
+		if (area > 0) {
+			stats.ops_len++;
+			stats.pixels_written += area;
+		}
+		scene_node_render(node, scene_output, render_pass, &render_regions[i]);
+		pixman_region32_fini(&render_regions[i]);
 
 		if (node->type == WLR_SCENE_NODE_BUFFER) {
 			struct wlr_scene_buffer *buffer = wlr_scene_buffer_from_node(node);
@@ -1749,6 +2249,7 @@ bool wlr_scene_output_commit(struct wlr_scene_output *scene_output) {
 
 	wlr_output_add_software_cursors_to_render_pass(output, render_pass, &damage);
 
+	free(render_regions);
 	pixman_region32_fini(&damage);
 
 	if (!wlr_render_pass_submit(render_pass)) {
@@ -1768,6 +2269,7 @@ bool wlr_scene_output_commit(struct wlr_scene_output *scene_output) {
 
 	if (success) {
 		wlr_damage_ring_rotate(&scene_output->damage_ring);
+		scene_output->frame_stats = stats;
 	}
 
 	if (debug_damage == WLR_SCENE_DEBUG_DAMAGE_HIGHLIGHT &&
@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <math.h>
 #include <stdlib.h>
 #include <wayland-server-core.h>
 #include <wlr/render/interface.h>
@@ -13,6 +14,7 @@
 #include "types/wlr_buffer.h"
 #include "types/wlr_region.h"
 #include "types/wlr_subcompositor.h"
+#include "util/env.h"
 #include "util/time.h"
 
 #define COMPOSITOR_VERSION 6
@@ -347,6 +349,121 @@ static void surface_state_move(struct wlr_surface_state *state,
 	next->cached_state_locks = 0;
 }
 
+/**
+ * Check whether a cached state can be squashed into the previous one. Attaching
+ * a NULL buffer unmaps the surface: keep these commits separate so that role
+ * and commit listeners still observe the unmap and the following map.
+ */
+static bool surface_state_can_merge(const struct wlr_surface_state *state,
+		const struct wlr_surface_state *next) {
+	if (!(next->committed & WLR_SURFACE_STATE_BUFFER)) {
+		return true;
+	}
+	bool state_unmaps = (state->committed & WLR_SURFACE_STATE_BUFFER) &&
+		state->buffer == NULL;
+	return next->buffer != NULL && !state_unmaps;
+}
+
+/**
+ * Squash a cached state into the cached state preceding it, as if both had
+ * been committed by the client at once. The intermediate buffer is released,
+ * damage is accumulated and frame callbacks are appended.
+ */
+static void surface_state_merge(struct wlr_surface_state *state,
+		struct wlr_surface_state *next) {
+	// Damage is expressed in coordinates which depend on the surface and
+	// buffer geometry. Only accumulate it if the geometry is unchanged,
+	// otherwise damage the whole buffer.
+	bool full_damage = state->width != next->width ||
+		state->height != next->height ||
+		state->buffer_width != next->buffer_width ||
+		state->buffer_height != next->buffer_height ||
+		(next->committed & (WLR_SURFACE_STATE_SCALE |
+			WLR_SURFACE_STATE_TRANSFORM | WLR_SURFACE_STATE_VIEWPORT));
+
+	state->width = next->width;
+	state->height = next->height;
+	state->buffer_width = next->buffer_width;
+	state->buffer_height = next->buffer_height;
+
+	if (next->committed & WLR_SURFACE_STATE_SCALE) {
+		state->scale = next->scale;
+	}
+	if (next->committed & WLR_SURFACE_STATE_TRANSFORM) {
+		state->transform = next->transform;
+	}
+	if (next->committed & WLR_SURFACE_STATE_OFFSET) {
+		state->dx += next->dx;
+		state->dy += next->dy;
+		next->dx = next->dy = 0;
+	}
+	if (next->committed & WLR_SURFACE_STATE_BUFFER) {
+		wlr_buffer_unlock(state->buffer);
+		state->buffer = next->buffer;
+		next->buffer = NULL;
+	}
+	if (full_damage) {
+		pixman_region32_clear(&state->surface_damage);
+		pixman_region32_fini(&state->buffer_damage);
+		pixman_region32_init_rect(&state->buffer_damage,
+			0, 0, state->buffer_width, state->buffer_height);
+		state->committed |= WLR_SURFACE_STATE_BUFFER_DAMAGE;
+	} else {
+		pixman_region32_union(&state->surface_damage,
+			&state->surface_damage, &next->surface_damage);
+		pixman_region32_union(&state->buffer_damage,
+			&state->buffer_damage, &next->buffer_damage);
+	}
+	pixman_region32_clear(&next->surface_damage);
+	pixman_region32_clear(&next->buffer_damage);
+	if (next->committed & WLR_SURFACE_STATE_OPAQUE_REGION) {
+		pixman_region32_copy(&state->opaque, &next->opaque);
+	}
+	if (next->committed & WLR_SURFACE_STATE_INPUT_REGION) {
+		pixman_region32_copy(&state->input, &next->input);
+	}
+	if (next->committed & WLR_SURFACE_STATE_VIEWPORT) {
+		memcpy(&state->viewport, &next->viewport, sizeof(state->viewport));
+	}
+	if (next->committed & WLR_SURFACE_STATE_FRAME_CALLBACK_LIST) {
+		wl_list_insert_list(state->frame_callback_list.prev,
+			&next->frame_callback_list);
+		wl_list_init(&next->frame_callback_list);
+	}
+
+	state->committed |= next->committed;
+	next->committed = 0;
+
+	state->seq = next->seq;
+}
+
+/**
+ * Scan the damaged pixels of the current buffer for opaque spans, or the whole
+ * buffer if full is set.
+ */
+static void surface_update_opaque_pixels(struct wlr_surface *surface,
+		bool full) {
+	struct wlr_buffer *buffer = surface->current.buffer;
+	if (surface->opaque || !surface->scan_opaque) {
+		pixman_region32_clear(&surface->opaque_pixels);
+		return;
+	}
+
+	pixman_region32_t damage;
+	if (full) {
+		pixman_region32_clear(&surface->opaque_pixels);
+		pixman_region32_init_rect(&damage, 0, 0, buffer->width, buffer->height);
+	} else {
+		pixman_region32_init(&damage);
+		pixman_region32_copy(&damage, &surface->buffer_damage);
+	}
+
+	if (!buffer_update_opaque_region(buffer, &surface->opaque_pixels, &damage)) {
+		pixman_region32_clear(&surface->opaque_pixels);
+	}
+	pixman_region32_fini(&damage);
+}
+
 static void surface_apply_damage(struct wlr_surface *surface) {
 	surface->has_buffer = surface->current.buffer;
 
@@ -357,11 +474,19 @@ static void surface_apply_damage(struct wlr_surface *surface) {
 		}
 		surface->buffer = NULL;
 		surface->opaque = false;
+		pixman_region32_clear(&surface->opaque_pixels);
 		return;
 	}
 
 	surface->opaque = buffer_is_opaque(surface->current.buffer);
 
+	// Many clients use a format with an alpha channel even though their
+	// buffer is opaque. Look at the pixels which changed to find out. Opaque
+	// spans are buffer-local, rescan everything if the buffer size changed.
+	bool resized = surface->current.buffer_width != surface->previous.buffer_width ||
+		surface->current.buffer_height != surface->previous.buffer_height;
+	surface_update_opaque_pixels(surface, resized);
+
 	if (surface->buffer != NULL) {
 		if (wlr_client_buffer_apply_damage(surface->buffer,
 				surface->current.buffer, &surface->buffer_damage)) {
@@ -383,12 +508,77 @@ static void surface_apply_damage(struct wlr_surface *surface) {
 		return;
 	}
 
+	// The damage didn't apply to the previous buffer, so it can't be trusted
+	// for the opaque spans either
+	if (!resized) {
+		surface_update_opaque_pixels(surface, true);
+	}
+
 	if (surface->buffer != NULL) {
 		wlr_buffer_unlock(&surface->buffer->base);
 	}
 	surface->buffer = buffer;
 }
 
+/**
+ * Convert the buffer-local region of opaque pixels to surface-local
+ * coordinates. Unlike damage, partially covered surface pixels are left out.
+ */
+static void surface_get_opaque_pixels(struct wlr_surface *surface,
+		pixman_region32_t *dst) {
+	struct wlr_surface_state *state = &surface->current;
+
+	pixman_region32_t region;
+	pixman_region32_init(&region);
+	wlr_region_transform(&region, &surface->opaque_pixels, state->transform,
+		state->buffer_width, state->buffer_height);
+
+	double src_x = 0, src_y = 0, src_width, src_height;
+	if (state->viewport.has_src) {
+		src_x = state->viewport.src.x;
+		src_y = state->viewport.src.y;
+		src_width = state->viewport.src.width;
+		src_height = state->viewport.src.height;
+	} else {
+		int width, height;
+		surface_state_transformed_buffer_size(state, &width, &height);
+		src_width = (double)width / state->scale;
+		src_height = (double)height / state->scale;
+	}
+	if (src_width <= 0 || src_height <= 0) {
+		pixman_region32_fini(&region);
+		return;
+	}
+	double scale_x = state->width / src_width;
+	double scale_y = state->height / src_height;
+
+	int nrects;
+	const pixman_box32_t *src_rects = pixman_region32_rectangles(&region, &nrects);
+	pixman_box32_t *dst_rects = malloc(nrects * sizeof(*dst_rects));
+	if (dst_rects == NULL) {
+		pixman_region32_fini(&region);
+		return;
+	}
+
+	int n = 0;
+	for (int i = 0; i < nrects; i++) {
+		pixman_box32_t box = {
+			.x1 = ceil(((double)src_rects[i].x1 / state->scale - src_x) * scale_x),
+			.y1 = ceil(((double)src_rects[i].y1 / state->scale - src_y) * scale_y),
+			.x2 = floor(((double)src_rects[i].x2 / state->scale - src_x) * scale_x),
+			.y2 = floor(((double)src_rects[i].y2 / state->scale - src_y) * scale_y),
+		};
+		if (box.x1 < box.x2 && box.y1 < box.y2) {
+			dst_rects[n++] = box;
+		}
+	}
+
+	pixman_region32_fini(dst);
+	pixman_region32_init_rects(dst, dst_rects, n);
+	free(dst_rects);
+	pixman_region32_fini(&region);
+}
+
 static void surface_update_opaque_region(struct wlr_surface *surface) {
 	if (!surface->has_buffer) {
 		pixman_region32_clear(&surface->opaque_region);
@@ -402,8 +592,18 @@ static void surface_update_opaque_region(struct wlr_surface *surface) {
 		return;
 	}
 
+	pixman_region32_copy(&surface->opaque_region, &surface->current.opaque);
+	if (pixman_region32_not_empty(&surface->opaque_pixels)) {
+		pixman_region32_t opaque_pixels;
+		pixman_region32_init(&opaque_pixels);
+		surface_get_opaque_pixels(surface, &opaque_pixels);
+		pixman_region32_union(&surface->opaque_region,
+			&surface->opaque_region, &opaque_pixels);
+		pixman_region32_fini(&opaque_pixels);
+	}
+
 	pixman_region32_intersect_rect(&surface->opaque_region,
-		&surface->current.opaque,
+		&surface->opaque_region,
 		0, 0, surface->current.width, surface->current.height);
 }
 
@@ -655,6 +855,7 @@ static void surface_handle_resource_destroy(struct wl_resource *resource) {
 	pixman_region32_fini(&surface->external_damage);
 	pixman_region32_fini(&surface->opaque_region);
 	pixman_region32_fini(&surface->input_region);
+	pixman_region32_fini(&surface->opaque_pixels);
 	if (surface->buffer != NULL) {
 		wlr_buffer_unlock(&surface->buffer->base);
 	}
@@ -704,6 +905,7 @@ static struct wlr_surface *surface_create(struct wl_client *client,
 	pixman_region32_init(&surface->external_damage);
 	pixman_region32_init(&surface->opaque_region);
 	pixman_region32_init(&surface->input_region);
+	pixman_region32_init(&surface->opaque_pixels);
 	wlr_addon_set_init(&surface->addons);
 
 	if (renderer != NULL) {
@@ -720,7 +922,7 @@ struct wlr_texture *wlr_surface_get_texture(struct wlr_surface *surface) {
 	if (surface->buffer == NULL) {
 		return NULL;
 	}
-	return surface->buffer->texture;
+	return wlr_client_buffer_get_texture(surface->buffer);
 }
 
 bool wlr_surface_has_buffer(struct wlr_surface *surface) {
@@ -799,15 +1001,31 @@ void wlr_surface_unlock_cached(struct wlr_surface *surface, uint32_t seq) {
 		return;
 	}
 
-	// TODO: consider merging all committed states together
+	// Squash consecutive unlocked states together, so that a client which
+	// queued up several commits behind a lock only gets one applied
+	struct wlr_surface_state *merged = NULL;
 	struct wlr_surface_state *next, *tmp;
 	wl_list_for_each_safe(next, tmp, &surface->cached, cached_state_link) {
 		if (next->cached_state_locks > 0) {
 			break;
 		}
 
-		surface_commit_state(surface, next);
-		surface_state_destroy_cached(next);
+		if (merged != NULL && surface_state_can_merge(merged, next)) {
+			surface_state_merge(merged, next);
+			surface_state_destroy_cached(next);
+			continue;
+		}
+
+		if (merged != NULL) {
+			surface_commit_state(surface, merged);
+			surface_state_destroy_cached(merged);
+		}
+		merged = next;
+	}
+
+	if (merged != NULL) {
+		surface_commit_state(surface, merged);
+		surface_state_destroy_cached(merged);
 	}
 }
 
@@ -1144,6 +1362,8 @@ static void compositor_create_surface(struct wl_client *client,
 		return;
 	}
 
+	surface->scan_opaque = compositor->scan_opaque;
+
 	wl_signal_emit_mutable(&compositor->events.new_surface, surface);
 }
 
@@ -1196,6 +1416,7 @@ struct wlr_compositor *wlr_compositor_create(struct wl_display *display,
 		return NULL;
 	}
 	compositor->renderer = renderer;
+	compositor->scan_opaque = env_parse_bool("WLR_SURFACE_SCAN_OPAQUE");
 
 	wl_signal_init(&compositor->events.new_surface);
 	wl_signal_init(&compositor->events.destroy);
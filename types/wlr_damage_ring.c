@@ -1,17 +1,17 @@
 #include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <pixman.h>
 #include <wlr/types/wlr_damage_ring.h>
 #include <wlr/util/box.h>
 
-#define WLR_DAMAGE_RING_MAX_RECTS 20
-
 void wlr_damage_ring_init(struct wlr_damage_ring *ring) {
 	memset(ring, 0, sizeof(*ring));
 
 	ring->width = INT_MAX;
 	ring->height = INT_MAX;
+	ring->max_rects = WLR_DAMAGE_RING_DEFAULT_MAX_RECTS;
 
 	pixman_region32_init(&ring->current);
 	for (size_t i = 0; i < WLR_DAMAGE_RING_PREVIOUS_LEN; ++i) {
@@ -84,6 +84,155 @@ void wlr_damage_ring_rotate(struct wlr_damage_ring *ring) {
 	pixman_region32_clear(&ring->current);
 }
 
+static int64_t box_area(const pixman_box32_t *box) {
+	return (int64_t)(box->x2 - box->x1) * (box->y2 - box->y1);
+}
+
+static pixman_box32_t box_union(const pixman_box32_t *a,
+		const pixman_box32_t *b) {
+	return (pixman_box32_t){
+		.x1 = a->x1 < b->x1 ? a->x1 : b->x1,
+		.y1 = a->y1 < b->y1 ? a->y1 : b->y1,
+		.x2 = a->x2 > b->x2 ? a->x2 : b->x2,
+		.y2 = a->y2 > b->y2 ? a->y2 : b->y2,
+	};
+}
+
+// Area which would be needlessly repainted if a and b were merged
+static int64_t merge_cost(const pixman_box32_t *a, const pixman_box32_t *b) {
+	pixman_box32_t merged = box_union(a, b);
+	return box_area(&merged) - box_area(a) - box_area(b);
+}
+
+static void find_best_merge(const pixman_box32_t *boxes, size_t boxes_len,
+		size_t i, size_t *best, int64_t *best_cost) {
+	*best = i;
+	*best_cost = INT64_MAX;
+	for (size_t j = 0; j < boxes_len; j++) {
+		if (j == i) {
+			continue;
+		}
+		int64_t cost = merge_cost(&boxes[i], &boxes[j]);
+		if (cost < *best_cost) {
+			*best = j;
+			*best_cost = cost;
+		}
+	}
+}
+
+/**
+ * Greedily merge the pair of boxes wasting the least area until at most
+ * max_boxes remain. Each box caches its cheapest merge partner, so that only
+ * boxes whose partner changed need a full scan after a merge.
+ */
+static size_t merge_boxes(pixman_box32_t *boxes, size_t boxes_len,
+		size_t max_boxes) {
+	size_t *best = malloc(boxes_len * sizeof(*best));
+	int64_t *best_cost = malloc(boxes_len * sizeof(*best_cost));
+	if (best == NULL || best_cost == NULL) {
+		free(best);
+		free(best_cost);
+		return 0;
+	}
+
+	for (size_t i = 0; i < boxes_len; i++) {
+		find_best_merge(boxes, boxes_len, i, &best[i], &best_cost[i]);
+	}
+
+	while (boxes_len > max_boxes) {
+		size_t a = 0;
+		for (size_t i = 1; i < boxes_len; i++) {
+			if (best_cost[i] < best_cost[a]) {
+				a = i;
+			}
+		}
+		size_t b = best[a];
+		if (b < a) {
+			size_t tmp = a;
+			a = b;
+			b = tmp;
+		}
+
+		// Merge b into a, then move the last box into b's slot
+		boxes[a] = box_union(&boxes[a], &boxes[b]);
+		size_t last = boxes_len - 1;
+		boxes[b] = boxes[last];
+		best[b] = best[last];
+		best_cost[b] = best_cost[last];
+		boxes_len--;
+
+		for (size_t i = 0; i < boxes_len; i++) {
+			if (i == a) {
+				continue;
+			}
+			if (best[i] == a || best[i] == b) {
+				// Our cached partner has been merged, rescan
+				find_best_merge(boxes, boxes_len, i, &best[i], &best_cost[i]);
+			} else {
+				if (best[i] == last) {
+					best[i] = b;
+				}
+				int64_t cost = merge_cost(&boxes[i], &boxes[a]);
+				if (cost < best_cost[i]) {
+					best[i] = a;
+					best_cost[i] = cost;
+				}
+			}
+		}
+		find_best_merge(boxes, boxes_len, a, &best[a], &best_cost[a]);
+	}
+
+	free(best);
+	free(best_cost);
+	return boxes_len;
+}
+
+/**
+ * Reduce the number of rectangles in the region to at most max_rects, while
+ * keeping the repainted area close to the original region.
+ */
+static void simplify_region(pixman_region32_t *region, size_t max_rects) {
+	int rects_len;
+	const pixman_box32_t *rects = pixman_region32_rectangles(region, &rects_len);
+	if ((size_t)rects_len <= max_rects) {
+		return;
+	}
+
+	pixman_box32_t *boxes = malloc(rects_len * sizeof(*boxes));
+	if (boxes == NULL) {
+		goto fallback;
+	}
+	memcpy(boxes, rects, rects_len * sizeof(*boxes));
+
+	// Merged boxes may overlap or straddle bands, which pixman splits into
+	// more rectangles. Tighten the target until the region fits the budget.
+	size_t boxes_len = rects_len;
+	for (size_t target = max_rects; target > 1; target /= 2) {
+		boxes_len = merge_boxes(boxes, boxes_len, target);
+		if (boxes_len == 0) {
+			break;
+		}
+
+		pixman_region32_t simplified;
+		pixman_region32_init_rects(&simplified, boxes, boxes_len);
+		if ((size_t)pixman_region32_n_rects(&simplified) <= max_rects) {
+			pixman_region32_fini(region);
+			*region = simplified;
+			free(boxes);
+			return;
+		}
+		pixman_region32_fini(&simplified);
+	}
+	free(boxes);
+
+fallback:;
+	pixman_box32_t *extents = pixman_region32_extents(region);
+	pixman_region32_union_rect(region, region,
+		extents->x1, extents->y1,
+		extents->x2 - extents->x1,
+		extents->y2 - extents->y1);
+}
+
 void wlr_damage_ring_get_buffer_damage(struct wlr_damage_ring *ring,
 		int buffer_age, pixman_region32_t *damage) {
 	if (buffer_age <= 0 || buffer_age - 1 > WLR_DAMAGE_RING_PREVIOUS_LEN) {
@@ -99,14 +248,8 @@ void wlr_damage_ring_get_buffer_damage(struct wlr_damage_ring *ring,
 			pixman_region32_union(damage, damage, &ring->previous[j]);
 		}
 
-		// Check the number of rectangles
-		int n_rects = pixman_region32_n_rects(damage);
-		if (n_rects > WLR_DAMAGE_RING_MAX_RECTS) {
-			pixman_box32_t *extents = pixman_region32_extents(damage);
-			pixman_region32_union_rect(damage, damage,
-				extents->x1, extents->y1,
-				extents->x2 - extents->x1,
-				extents->y2 - extents->y1);
+		if (ring->max_rects > 0) {
+			simplify_region(damage, ring->max_rects);
 		}
 	}
 }
@@ -12,6 +12,7 @@
 #include <wlr/types/wlr_shm.h>
 #include <wlr/util/log.h>
 #include "render/pixel_format.h"
+#include "render/wlr_renderer.h"
 
 #ifdef __STDC_NO_ATOMICS__
 #error "C11 atomics are required"
@@ -556,7 +557,15 @@ struct wlr_shm *wlr_shm_create_with_renderer(struct wl_display *display,
 		return NULL;
 	}
 
-	return wlr_shm_create(display, version, formats, formats_len);
+	struct wlr_shm *shm = wlr_shm_create(display, version, formats, formats_len);
+	if (shm == NULL) {
+		return NULL;
+	}
+
+	// Lets the renderer finish deferred work on our buffers, e.g. release
+	// them after asynchronous uploads, without waiting for the next frame
+	renderer_set_event_loop(renderer, wl_display_get_event_loop(display));
+	return shm;
 }
 
 static bool shm_has_format(struct wlr_shm *shm, uint32_t shm_format) {
@@ -0,0 +1,199 @@
+#include <assert.h>
+#include <drm_fourcc.h>
+#include <stdlib.h>
+#include <wlr/render/wlr_texture.h>
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/types/wlr_texture_cache.h>
+#include <wlr/util/log.h>
+#include "render/pixel_format.h"
+#include "types/wlr_buffer.h"
+
+#define DEFAULT_MIN_IDLE_FRAMES 120
+// Reading back a texture stalls the renderer, limit the damage per frame
+#define MAX_EVICTIONS_PER_FRAME 4
+
+struct wlr_texture_cache *wlr_texture_cache_create(size_t budget) {
+	struct wlr_texture_cache *cache = calloc(1, sizeof(*cache));
+	if (cache == NULL) {
+		return NULL;
+	}
+
+	cache->budget = budget;
+	cache->min_idle_frames = DEFAULT_MIN_IDLE_FRAMES;
+	wl_list_init(&cache->buffers);
+	wl_signal_init(&cache->events.destroy);
+
+	return cache;
+}
+
+void wlr_texture_cache_destroy(struct wlr_texture_cache *cache) {
+	if (cache == NULL) {
+		return;
+	}
+
+	wl_signal_emit_mutable(&cache->events.destroy, NULL);
+
+	struct wlr_client_buffer *buffer, *tmp;
+	wl_list_for_each_safe(buffer, tmp, &cache->buffers, texture_cache_link) {
+		wl_list_remove(&buffer->texture_cache_link);
+		wl_list_init(&buffer->texture_cache_link);
+		buffer->texture_cache = NULL;
+		buffer->texture_cache_displayed = 0;
+	}
+
+	free(cache);
+}
+
+void wlr_texture_cache_add(struct wlr_texture_cache *cache,
+		struct wlr_client_buffer *buffer) {
+	if (buffer->texture_cache == cache) {
+		wlr_texture_cache_mark_visible(cache, buffer);
+		return;
+	}
+	assert(buffer->texture_cache == NULL);
+
+	// Single-color buffers only get a texture on demand, a tiny one
+	if (buffer->solid) {
+		return;
+	}
+
+	// Textures imported from a DMA-BUF don't hold a copy of the pixels
+	struct wlr_dmabuf_attributes dmabuf;
+	if (wlr_buffer_get_dmabuf(&buffer->base, &dmabuf)) {
+		return;
+	}
+
+	buffer->texture_cache = cache;
+	buffer->texture_cache_frame = cache->frame;
+	wl_list_insert(cache->buffers.prev, &buffer->texture_cache_link);
+
+	size_t size = client_buffer_texture_size(buffer);
+	if (buffer->texture != NULL) {
+		cache->stats.resident_textures++;
+		cache->stats.resident_bytes += size;
+	} else if (buffer->evicted_data != NULL) {
+		cache->stats.evicted_textures++;
+		cache->stats.evicted_bytes += size;
+	}
+}
+
+void wlr_texture_cache_mark_visible(struct wlr_texture_cache *cache,
+		struct wlr_client_buffer *buffer) {
+	if (buffer->texture_cache != cache) {
+		return;
+	}
+
+	// Keep the list sorted from least to most recently visible
+	buffer->texture_cache_frame = cache->frame;
+	wl_list_remove(&buffer->texture_cache_link);
+	wl_list_insert(cache->buffers.prev, &buffer->texture_cache_link);
+}
+
+void wlr_texture_cache_set_displayed(struct wlr_texture_cache *cache,
+		struct wlr_client_buffer *buffer, bool displayed) {
+	if (buffer->texture_cache != cache) {
+		return;
+	}
+
+	if (displayed) {
+		buffer->texture_cache_displayed++;
+	} else if (buffer->texture_cache_displayed > 0) {
+		buffer->texture_cache_displayed--;
+		if (buffer->texture_cache_displayed == 0) {
+			wlr_texture_cache_mark_visible(cache, buffer);
+		}
+	}
+}
+
+void texture_cache_remove_buffer(struct wlr_client_buffer *buffer) {
+	struct wlr_texture_cache *cache = buffer->texture_cache;
+	if (cache == NULL) {
+		return;
+	}
+
+	size_t size = client_buffer_texture_size(buffer);
+	if (buffer->texture != NULL) {
+		cache->stats.resident_textures--;
+		cache->stats.resident_bytes -= size;
+	} else if (buffer->evicted_data != NULL) {
+		cache->stats.evicted_textures--;
+		cache->stats.evicted_bytes -= size;
+	}
+
+	wl_list_remove(&buffer->texture_cache_link);
+	wl_list_init(&buffer->texture_cache_link);
+	buffer->texture_cache = NULL;
+	buffer->texture_cache_displayed = 0;
+}
+
+void texture_cache_handle_restore(struct wlr_client_buffer *buffer) {
+	struct wlr_texture_cache *cache = buffer->texture_cache;
+	if (cache == NULL) {
+		return;
+	}
+
+	size_t size = client_buffer_texture_size(buffer);
+	cache->stats.evicted_textures--;
+	cache->stats.evicted_bytes -= size;
+	cache->stats.resident_textures++;
+	cache->stats.resident_bytes += size;
+	cache->stats.restores++;
+}
+
+static bool client_buffer_evict(struct wlr_client_buffer *buffer) {
+	// Read back in the texture's own format, so that restoring it is lossless
+	const struct wlr_pixel_format_info *info =
+		drm_get_pixel_format_info(buffer->format);
+	if (info == NULL || pixel_format_info_pixels_per_block(info) != 1) {
+		return false;
+	}
+
+	uint32_t stride = pixel_format_info_min_stride(info, buffer->base.width);
+	void *data = malloc((size_t)stride * buffer->base.height);
+	if (data == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return false;
+	}
+
+	if (!wlr_texture_read_pixels(buffer->texture, buffer->format,
+			stride, data)) {
+		free(data);
+		return false;
+	}
+
+	wlr_texture_destroy(buffer->texture);
+	buffer->texture = NULL;
+	buffer->evicted_data = data;
+	return true;
+}
+
+void wlr_texture_cache_end_frame(struct wlr_texture_cache *cache) {
+	cache->frame++;
+
+	int evictions = 0;
+	struct wlr_client_buffer *buffer;
+	wl_list_for_each(buffer, &cache->buffers, texture_cache_link) {
+		if (cache->stats.resident_bytes <= cache->budget ||
+				evictions >= MAX_EVICTIONS_PER_FRAME) {
+			break;
+		}
+		if (buffer->texture_cache_displayed > 0) {
+			continue;
+		}
+		if (cache->frame - buffer->texture_cache_frame < cache->min_idle_frames) {
+			// The list is sorted, all following buffers are more recent
+			break;
+		}
+		if (buffer->texture == NULL || !client_buffer_evict(buffer)) {
+			continue;
+		}
+
+		size_t size = client_buffer_texture_size(buffer);
+		cache->stats.resident_textures--;
+		cache->stats.resident_bytes -= size;
+		cache->stats.evicted_textures++;
+		cache->stats.evicted_bytes += size;
+		cache->stats.evictions++;
+		evictions++;
+	}
+}
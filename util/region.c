@@ -111,9 +111,14 @@ void wlr_region_transform(pixman_region32_t *dst, const pixman_region32_t *src,
 
 void wlr_region_expand(pixman_region32_t *dst, const pixman_region32_t *src,
 		int distance) {
-	assert(distance >= 0);
+	wlr_region_expand_xy(dst, src, distance, distance);
+}
+
+void wlr_region_expand_xy(pixman_region32_t *dst, const pixman_region32_t *src,
+		int distance_x, int distance_y) {
+	assert(distance_x >= 0 && distance_y >= 0);
 
-	if (distance == 0) {
+	if (distance_x == 0 && distance_y == 0) {
 		pixman_region32_copy(dst, src);
 		return;
 	}
@@ -127,10 +132,10 @@ void wlr_region_expand(pixman_region32_t *dst, const pixman_region32_t *src,
 	}
 
 	for (int i = 0; i < nrects; ++i) {
-		dst_rects[i].x1 = src_rects[i].x1 - distance;
-		dst_rects[i].x2 = src_rects[i].x2 + distance;
-		dst_rects[i].y1 = src_rects[i].y1 - distance;
-		dst_rects[i].y2 = src_rects[i].y2 + distance;
+		dst_rects[i].x1 = src_rects[i].x1 - distance_x;
+		dst_rects[i].x2 = src_rects[i].x2 + distance_x;
+		dst_rects[i].y1 = src_rects[i].y1 - distance_y;
+		dst_rects[i].y2 = src_rects[i].y2 + distance_y;
 	}
 
 	pixman_region32_fini(dst);
@@ -1,5 +1,6 @@
 #define _POSIX_C_SOURCE 200809L
 #include <assert.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
@@ -56,18 +57,25 @@ xwm_selection_find_incoming_transfer_by_window(
 	return NULL;
 }
 
+/**
+ * Read the next slice of the selection property. The X server deletes the
+ * property once its last slice has been read, so that the owner of an INCR
+ * selection can prepare the next chunk while this one is written to the
+ * Wayland client.
+ */
 static bool xwm_selection_transfer_get_incoming_selection_property(
-		struct wlr_xwm_selection_transfer *transfer, bool delete) {
+		struct wlr_xwm_selection_transfer *transfer) {
 	struct wlr_xwm *xwm = transfer->selection->xwm;
 
+	uint32_t length = xwm->selection_chunk_size / 4;
 	xcb_get_property_cookie_t cookie = xcb_get_property(
 		xwm->xcb_conn,
-		delete,
+		1, // delete
 		transfer->incoming_window,
 		xwm->atoms[WL_SELECTION],
 		XCB_GET_PROPERTY_TYPE_ANY,
-		0, // offset
-		0x1fffffff // length
+		transfer->property_offset,
+		length
 	);
 
 	transfer->property_start = 0;
@@ -79,40 +87,38 @@ static bool xwm_selection_transfer_get_incoming_selection_property(
 		return false;
 	}
 
+	if (transfer->property_reply->bytes_after > 0) {
+		transfer->property_offset += length;
+	} else {
+		transfer->property_offset = 0;
+	}
+
 	return true;
 }
 
-static void xwm_notify_ready_for_next_incr_chunk(
-		struct wlr_xwm_selection_transfer *transfer) {
-	struct wlr_xwm *xwm = transfer->selection->xwm;
-	assert(transfer->incr);
-
-	wlr_log(WLR_DEBUG, "deleting property");
-	xcb_delete_property(xwm->xcb_conn, transfer->incoming_window,
-		xwm->atoms[WL_SELECTION]);
-	xcb_flush(xwm->xcb_conn);
-
-	xwm_selection_transfer_remove_event_source(transfer);
-	xwm_selection_transfer_destroy_property_reply(transfer);
-}
+enum xwm_write_status {
+	XWM_WRITE_DONE,
+	XWM_WRITE_PENDING,
+	XWM_WRITE_ERROR,
+};
 
 /**
- * Write the X11 selection to a Wayland client. Returns a nonzero value if the
- * Wayland client might become writeable again in the future.
+ * Write the current slice of the X11 selection to the Wayland client.
  */
-static int write_selection_property_to_wl_client(int fd, uint32_t mask,
-		void *data) {
-	struct wlr_xwm_selection_transfer *transfer = data;
-
+static enum xwm_write_status write_selection_property_slice(
+		struct wlr_xwm_selection_transfer *transfer) {
+	int fd = transfer->wl_client_fd;
 	char *property = xcb_get_property_value(transfer->property_reply);
 	int remainder = xcb_get_property_value_length(transfer->property_reply) -
 		transfer->property_start;
 
 	ssize_t len = write(fd, property + transfer->property_start, remainder);
 	if (len == -1) {
+		if (errno == EAGAIN) {
+			return XWM_WRITE_PENDING;
+		}
 		wlr_log_errno(WLR_ERROR, "write error to target fd %d", fd);
-		xwm_selection_transfer_destroy(transfer);
-		return 0;
+		return XWM_WRITE_ERROR;
 	}
 
 	wlr_log(WLR_DEBUG,
@@ -120,39 +126,90 @@ static int write_selection_property_to_wl_client(int fd, uint32_t mask,
 		len, transfer->property_start + len, remainder,
 		xcb_get_property_value_length(transfer->property_reply), fd);
 
-	if (len < remainder) {
-		transfer->property_start += len;
+	transfer->property_start += len;
+	transfer->transferred += len;
+	return len < remainder ? XWM_WRITE_PENDING : XWM_WRITE_DONE;
+}
+
+static void xwm_selection_transfer_pump(
+	struct wlr_xwm_selection_transfer *transfer);
+
+static int write_selection_property_to_wl_client(int fd, uint32_t mask,
+		void *data) {
+	struct wlr_xwm_selection_transfer *transfer = data;
+
+	switch (write_selection_property_slice(transfer)) {
+	case XWM_WRITE_PENDING:
 		return 1;
-	} else if (transfer->incr) {
-		xwm_notify_ready_for_next_incr_chunk(transfer);
-	} else {
-		wlr_log(WLR_DEBUG, "transfer complete");
+	case XWM_WRITE_ERROR:
 		xwm_selection_transfer_destroy(transfer);
+		return 0;
+	case XWM_WRITE_DONE:
+		xwm_selection_transfer_remove_event_source(transfer);
+		xwm_selection_transfer_pump(transfer);
+		return 0;
 	}
 
-	return 0;
+	abort(); // unreachable
 }
 
-static void xwm_write_selection_property_to_wl_client(
+/**
+ * Move the X11 selection to the Wayland client, one slice at a time, until
+ * the client can't accept more data or the current INCR chunk has been
+ * entirely read. At most one slice is held in memory.
+ */
+static void xwm_selection_transfer_pump(
 		struct wlr_xwm_selection_transfer *transfer) {
-	if (transfer->incr && transfer->wl_client_fd < 0) {
-		// Wayland client closed its pipe prematurely before the X11 client finished
-		// its incremental transfer. Continue draining the X11 client.
-		xwm_notify_ready_for_next_incr_chunk(transfer);
-		return;
-	}
+	while (true) {
+		if (transfer->property_reply == NULL) {
+			if (!xwm_selection_transfer_get_incoming_selection_property(
+					transfer)) {
+				xwm_selection_transfer_destroy(transfer);
+				return;
+			}
+
+			if (xcb_get_property_value_length(transfer->property_reply) == 0) {
+				wlr_log(WLR_DEBUG, "transfer complete");
+				xwm_selection_transfer_destroy(transfer);
+				return;
+			}
+		}
+
+		// If the Wayland client closed its pipe prematurely, continue
+		// draining the X11 client
+		if (transfer->wl_client_fd >= 0) {
+			enum xwm_write_status status =
+				write_selection_property_slice(transfer);
+			if (status == XWM_WRITE_ERROR) {
+				xwm_selection_transfer_destroy(transfer);
+				return;
+			} else if (status == XWM_WRITE_PENDING) {
+				// The Wayland client was unable to accept all of the slice,
+				// complete the write asynchronously
+				struct wl_event_loop *loop = wl_display_get_event_loop(
+					transfer->selection->xwm->xwayland->wl_display);
+				transfer->event_source = wl_event_loop_add_fd(loop,
+					transfer->wl_client_fd, WL_EVENT_WRITABLE,
+					write_selection_property_to_wl_client, transfer);
+				return;
+			}
+		}
+
+		bool last_slice = transfer->property_reply->bytes_after == 0;
+		xwm_selection_transfer_destroy_property_reply(transfer);
 
-	bool wl_client_finished_consuming = !write_selection_property_to_wl_client(
-			transfer->wl_client_fd, WL_EVENT_WRITABLE, transfer);
-	if (!wl_client_finished_consuming) {
-		// Wrote out part of the property to the Wayland client, but the client was
-		// unable to accept all of it. Schedule an event to asynchronously complete
-		// the transfer.
-		struct wl_event_loop *loop =
-			wl_display_get_event_loop(transfer->selection->xwm->xwayland->wl_display);
-		transfer->event_source = wl_event_loop_add_fd(loop,
-			transfer->wl_client_fd, WL_EVENT_WRITABLE,
-			write_selection_property_to_wl_client, transfer);
+		if (last_slice) {
+			if (!transfer->incr) {
+				wlr_log(WLR_DEBUG, "transfer complete");
+				xwm_selection_transfer_destroy(transfer);
+				return;
+			}
+			if (!transfer->incr_chunk_pending) {
+				// Wait for the X11 client to set the next chunk
+				return;
+			}
+			transfer->incr_chunk_pending = false;
+		}
 	}
 }
 
@@ -160,27 +217,20 @@ void xwm_get_incr_chunk(struct wlr_xwm_selection_transfer *transfer) {
 	wlr_log(WLR_DEBUG, "xwm_get_incr_chunk");
 
 	if (transfer->property_reply) {
-		wlr_log(WLR_ERROR, "X11 client offered a new property before we deleted");
+		// Still writing the previous chunk, read this one afterwards
+		transfer->incr_chunk_pending = true;
 		return;
 	}
 
-	if (!xwm_selection_transfer_get_incoming_selection_property(transfer, false)) {
-		return;
-	}
-
-	if (xcb_get_property_value_length(transfer->property_reply) > 0) {
-		xwm_write_selection_property_to_wl_client(transfer);
-	} else {
-		wlr_log(WLR_DEBUG, "incremental transfer complete");
-		xwm_selection_transfer_destroy(transfer);
-	}
+	xwm_selection_transfer_pump(transfer);
 }
 
 static void xwm_selection_transfer_get_data(
 		struct wlr_xwm_selection_transfer *transfer) {
 	struct wlr_xwm *xwm = transfer->selection->xwm;
 
-	if (!xwm_selection_transfer_get_incoming_selection_property(transfer, true)) {
+	if (!xwm_selection_transfer_get_incoming_selection_property(transfer)) {
+		xwm_selection_transfer_destroy(transfer);
 		return;
 	}
 
@@ -190,7 +240,7 @@ static void xwm_selection_transfer_get_data(
 	} else {
 		// Reply's ownership is transferred to wm, which is responsible for freeing
 		// it.
-		xwm_write_selection_property_to_wl_client(transfer);
+		xwm_selection_transfer_pump(transfer);
 	}
 }
 
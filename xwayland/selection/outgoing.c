@@ -35,20 +35,34 @@ static void xwm_selection_send_notify(struct wlr_xwm *xwm,
 	xcb_flush(xwm->xcb_conn);
 }
 
+/**
+ * Set the property to the next chunk of buffered data. Anything past the chunk
+ * size stays buffered, so that the request never exceeds the maximum request
+ * length.
+ */
 static int xwm_selection_flush_source_data(
 		struct wlr_xwm_selection_transfer *transfer) {
-	xcb_change_property(transfer->selection->xwm->xcb_conn,
+	struct wlr_xwm *xwm = transfer->selection->xwm;
+	size_t length = transfer->source_data.size;
+	if (length > xwm->selection_chunk_size) {
+		length = xwm->selection_chunk_size;
+	}
+
+	xcb_change_property(xwm->xcb_conn,
 		XCB_PROP_MODE_REPLACE,
 		transfer->request.requestor,
 		transfer->request.property,
 		transfer->request.target,
 		8, // format
-		transfer->source_data.size,
+		length,
 		transfer->source_data.data);
-	xcb_flush(transfer->selection->xwm->xcb_conn);
+	xcb_flush(xwm->xcb_conn);
 	transfer->property_set = true;
-	size_t length = transfer->source_data.size;
-	transfer->source_data.size = 0;
+	transfer->transferred += length;
+
+	char *data = transfer->source_data.data;
+	memmove(data, data + length, transfer->source_data.size - length);
+	transfer->source_data.size -= length;
 	return length;
 }
 
@@ -59,6 +73,7 @@ void xwm_selection_transfer_destroy_outgoing(
 		struct wlr_xwm_selection_transfer *transfer) {
 	wl_list_remove(&transfer->link);
 	wlr_log(WLR_DEBUG, "Destroying transfer %p", transfer);
+	xwm_selection_transfer_log_stats(transfer);
 
 	xwm_selection_transfer_remove_event_source(transfer);
 	xwm_selection_transfer_close_wl_client_fd(transfer);
@@ -70,10 +85,13 @@ static int xwm_data_source_read(int fd, uint32_t mask, void *data) {
 	struct wlr_xwm_selection_transfer *transfer = data;
 	struct wlr_xwm *xwm = transfer->selection->xwm;
 
+	// Less than two chunks are buffered: the data source isn't polled while
+	// waiting for the requestor to delete the previous chunk
+	size_t chunk_size = xwm->selection_chunk_size;
 	void *p;
 	size_t current = transfer->source_data.size;
-	if (transfer->source_data.size < INCR_CHUNK_SIZE) {
-		p = wl_array_add(&transfer->source_data, INCR_CHUNK_SIZE);
+	if (transfer->source_data.size < chunk_size) {
+		p = wl_array_add(&transfer->source_data, chunk_size);
 		if (p == NULL) {
 			wlr_log(WLR_ERROR, "Could not allocate selection source_data");
 			goto error_out;
@@ -93,12 +111,12 @@ static int xwm_data_source_read(int fd, uint32_t mask, void *data) {
 		available, mask);
 
 	transfer->source_data.size = current + len;
-	if (transfer->source_data.size >= INCR_CHUNK_SIZE) {
+	if (transfer->source_data.size >= chunk_size) {
 		if (!transfer->incr) {
 			wlr_log(WLR_DEBUG, "got %zu bytes, starting incr",
 				transfer->source_data.size);
 
-			size_t incr_chunk_size = INCR_CHUNK_SIZE;
+			uint32_t incr_chunk_size = chunk_size;
 			xcb_change_property(xwm->xcb_conn,
 				XCB_PROP_MODE_REPLACE,
 				transfer->request.requestor,
@@ -121,6 +139,11 @@ static int xwm_data_source_read(int fd, uint32_t mask, void *data) {
 			wlr_log(WLR_DEBUG, "got %zu bytes, property deleted, setting new "
 				"property", transfer->source_data.size);
 			xwm_selection_flush_source_data(transfer);
+			if (transfer->source_data.size >= chunk_size) {
+				// A full chunk is still buffered, wait for the next delete
+				transfer->flush_property_on_delete = true;
+				xwm_selection_transfer_remove_event_source(transfer);
+			}
 		}
 	} else if (len == 0 && !transfer->incr) {
 		wlr_log(WLR_DEBUG, "non-incr transfer complete");
@@ -163,7 +186,12 @@ void xwm_send_incr_chunk(struct wlr_xwm_selection_transfer *transfer) {
 		transfer->flush_property_on_delete = false;
 		int length = xwm_selection_flush_source_data(transfer);
 
-		if (transfer->wl_client_fd >= 0) {
+		size_t chunk_size = transfer->selection->xwm->selection_chunk_size;
+		if (transfer->source_data.size >= chunk_size ||
+				(transfer->source_data.size > 0 && transfer->wl_client_fd < 0)) {
+			// Send the rest of the buffered data on the next delete
+			transfer->flush_property_on_delete = true;
+		} else if (transfer->wl_client_fd >= 0) {
 			xwm_selection_transfer_start_outgoing(transfer);
 		} else if (length > 0) {
 			/* Transfer is all done, but queue a flush for
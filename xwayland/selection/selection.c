@@ -1,12 +1,14 @@
 #define _POSIX_C_SOURCE 200809L
 #include <assert.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <wlr/types/wlr_data_device.h>
 #include <wlr/util/log.h>
 #include <xcb/xfixes.h>
+#include "util/time.h"
 #include "xwayland/selection.h"
 #include "xwayland/xwm.h"
 
@@ -37,6 +39,31 @@ void xwm_selection_transfer_init(struct wlr_xwm_selection_transfer *transfer,
 	memset(transfer, 0, sizeof(*transfer));
 	transfer->selection = selection;
 	transfer->wl_client_fd = -1;
+	transfer->start_msec = get_current_time_msec();
+}
+
+void xwm_selection_transfer_log_stats(
+		struct wlr_xwm_selection_transfer *transfer) {
+	int64_t duration = get_current_time_msec() - transfer->start_msec;
+	wlr_log(WLR_DEBUG, "Transfer %p: %zu bytes in %" PRId64 " ms (%" PRId64
+		" KiB/s)", transfer, transfer->transferred, duration,
+		(int64_t)transfer->transferred * 1000 / 1024 /
+		(duration > 0 ? duration : 1));
+}
+
+size_t xwm_selection_get_chunk_size(struct wlr_xwm *xwm) {
+	// The chunk must fit in a single ChangeProperty request, leave some room
+	// for its header. The maximum request length is in 32-bit units.
+	size_t max_request_size =
+		(size_t)xcb_get_maximum_request_length(xwm->xcb_conn) * 4;
+	size_t size = max_request_size > 1024 ? max_request_size - 1024 : 0;
+	if (size > MAX_INCR_CHUNK_SIZE) {
+		size = MAX_INCR_CHUNK_SIZE;
+	}
+	if (size < MIN_INCR_CHUNK_SIZE) {
+		size = MIN_INCR_CHUNK_SIZE;
+	}
+	return size;
 }
 
 void xwm_selection_transfer_destroy(
@@ -45,6 +72,7 @@ void xwm_selection_transfer_destroy(
 		return;
 	}
 
+	xwm_selection_transfer_log_stats(transfer);
 	xwm_selection_transfer_destroy_property_reply(transfer);
 	xwm_selection_transfer_remove_event_source(transfer);
 	xwm_selection_transfer_close_wl_client_fd(transfer);
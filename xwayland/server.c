@@ -2,6 +2,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -17,6 +18,7 @@
 #include <wlr/xwayland.h>
 #include "config.h"
 #include "sockets.h"
+#include "util/time.h"
 
 static void safe_close(int fd) {
 	if (fd >= 0) {
@@ -195,6 +197,15 @@ static void server_finish_display(struct wlr_xwayland_server *server) {
 static bool server_start(struct wlr_xwayland_server *server);
 static bool server_start_lazy(struct wlr_xwayland_server *server);
 
+static bool server_start_spare(struct wlr_xwayland_server *server) {
+	if (!server_start(server)) {
+		return false;
+	}
+	server->spare = true;
+	server->stats.spare_starts++;
+	return true;
+}
+
 static void handle_client_destroy(struct wl_listener *listener, void *data) {
 	struct wlr_xwayland_server *server =
 		wl_container_of(listener, server, client_destroy);
@@ -211,7 +222,10 @@ static void handle_client_destroy(struct wl_listener *listener, void *data) {
 	server_finish_process(server);
 
 	if (time(NULL) - server->server_start > 5) {
-		if (server->options.lazy) {
+		if (server->options.lazy && server->options.prewarm) {
+			wlr_log(WLR_INFO, "Restarting Xwayland (spare)");
+			server_start_spare(server);
+		} else if (server->options.lazy) {
 			wlr_log(WLR_INFO, "Restarting Xwayland (lazy)");
 			server_start_lazy(server);
 		} else  {
@@ -221,6 +235,20 @@ static void handle_client_destroy(struct wl_listener *listener, void *data) {
 	}
 }
 
+static int handle_spare_timeout(void *data) {
+	struct wlr_xwayland_server *server = data;
+	if (!server->spare || server->client == NULL || server->pipe_source) {
+		return 0;
+	}
+
+	// Xwayland exits once its connections are closed
+	wlr_log(WLR_INFO, "Stopping unused spare Xwayland, restarting lazily");
+	server_finish_process(server);
+	server->stats.spare_teardowns++;
+	server_start_lazy(server);
+	return 0;
+}
+
 static void handle_display_destroy(struct wl_listener *listener, void *data) {
 	struct wlr_xwayland_server *server =
 		wl_container_of(listener, server, display_destroy);
@@ -270,12 +298,20 @@ static int xserver_handle_ready(int fd, uint32_t mask, void *data) {
 		wlr_log(WLR_ERROR, "Xwayland startup failed, not setting up xwm");
 		goto error;
 	}
-	wlr_log(WLR_DEBUG, "Xserver is ready");
+	server->stats.last_startup_msec =
+		get_current_time_msec() - server->start_msec;
+	wlr_log(WLR_INFO, "Xwayland is ready after %" PRId64 " ms%s",
+		server->stats.last_startup_msec, server->spare ? " (spare)" : "");
 
 	close(fd);
 	wl_event_source_remove(server->pipe_source);
 	server->pipe_source = NULL;
 
+	if (server->spare && server->spare_timer != NULL) {
+		wl_event_source_timer_update(server->spare_timer,
+			server->options.prewarm_idle_timeout * 1000);
+	}
+
 	struct wlr_xwayland_server_ready_event event = {
 		.server = server,
 		.wm_fd = server->wm_fd[0],
@@ -336,6 +372,8 @@ static bool server_start(struct wlr_xwayland_server *server) {
 	}
 
 	server->server_start = time(NULL);
+	server->start_msec = get_current_time_msec();
+	server->stats.starts++;
 
 	server->client = wl_client_create(server->wl_display, server->wl_fd[0]);
 	if (!server->client) {
@@ -429,7 +467,12 @@ static bool server_start_lazy(struct wlr_xwayland_server *server) {
 static void handle_idle(void *data) {
 	struct wlr_xwayland_server *server = data;
 	server->idle_source = NULL;
-	server_start(server);
+	if (server->options.lazy) {
+		// Only reached with prewarm
+		server_start_spare(server);
+	} else {
+		server_start(server);
+	}
 }
 
 void wlr_xwayland_server_destroy(struct wlr_xwayland_server *server) {
@@ -440,6 +483,9 @@ void wlr_xwayland_server_destroy(struct wlr_xwayland_server *server) {
 	if (server->idle_source != NULL) {
 		wl_event_source_remove(server->idle_source);
 	}
+	if (server->spare_timer != NULL) {
+		wl_event_source_remove(server->spare_timer);
+	}
 	server_finish_process(server);
 	server_finish_display(server);
 	wl_signal_emit_mutable(&server->events.destroy, NULL);
@@ -479,20 +525,35 @@ struct wlr_xwayland_server *wlr_xwayland_server_create(
 		goto error_alloc;
 	}
 
-	if (server->options.lazy) {
-		if (!server_start_lazy(server)) {
+	struct wl_event_loop *loop = wl_display_get_event_loop(wl_display);
+	if (server->options.lazy && server->options.prewarm &&
+			server->options.enable_wm &&
+			server->options.prewarm_idle_timeout > 0) {
+		server->spare_timer = wl_event_loop_add_timer(loop,
+			handle_spare_timeout, server);
+		if (server->spare_timer == NULL) {
 			goto error_display;
 		}
+	}
+
+	if (server->options.lazy && !server->options.prewarm) {
+		if (!server_start_lazy(server)) {
+			goto error_timer;
+		}
 	} else {
-		struct wl_event_loop *loop = wl_display_get_event_loop(wl_display);
 		server->idle_source = wl_event_loop_add_idle(loop, handle_idle, server);
 		if (server->idle_source == NULL) {
-			goto error_display;
+			goto error_timer;
 		}
 	}
 
 	return server;
 
+error_timer:
+	if (server->spare_timer != NULL) {
+		wl_event_source_remove(server->spare_timer);
+	}
+
 error_display:
 	server_finish_display(server);
 error_alloc:
@@ -1,6 +1,7 @@
 #define _POSIX_C_SOURCE 200809L
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -15,8 +16,13 @@
 #include <wlr/xwayland/shell.h>
 #include <wlr/xwayland/xwayland.h>
 #include "sockets.h"
+#include "util/env.h"
+#include "util/time.h"
 #include "xwayland/xwm.h"
 
+// Keep an unused spare Xwayland for 5 minutes by default
+#define DEFAULT_PREWARM_IDLE_TIMEOUT 300
+
 struct wlr_xwayland_cursor {
 	uint8_t *pixels;
 	uint32_t stride;
@@ -60,6 +66,9 @@ static void handle_server_ready(struct wl_listener *listener, void *data) {
 			cur->height, cur->hotspot_x, cur->hotspot_y);
 	}
 
+	wlr_log(WLR_DEBUG, "XWM is ready after %" PRId64 " ms",
+		get_current_time_msec() - event->server->start_msec);
+
 	wl_signal_emit_mutable(&xwayland->events.ready, NULL);
 }
 
@@ -105,7 +114,22 @@ struct wlr_xwayland *wlr_xwayland_create(struct wl_display *wl_display,
 #if HAVE_XCB_XFIXES_SET_CLIENT_DISCONNECT_MODE
 		.terminate_delay = lazy ? 10 : 0,
 #endif
+		.prewarm = lazy && env_parse_bool("WLR_XWAYLAND_PREWARM"),
+		.prewarm_idle_timeout = DEFAULT_PREWARM_IDLE_TIMEOUT,
 	};
+
+	const char *idle_timeout = getenv("WLR_XWAYLAND_PREWARM_IDLE_TIMEOUT");
+	if (idle_timeout != NULL) {
+		char *end;
+		long timeout = strtol(idle_timeout, &end, 10);
+		if (*idle_timeout == '\0' || *end != '\0' || timeout < 0 ||
+				timeout > INT32_MAX / 1000) {
+			wlr_log(WLR_ERROR, "Invalid WLR_XWAYLAND_PREWARM_IDLE_TIMEOUT "
+				"value: '%s'", idle_timeout);
+		} else {
+			options.prewarm_idle_timeout = timeout;
+		}
+	}
 	xwayland->server = wlr_xwayland_server_create(wl_display, &options);
 	if (xwayland->server == NULL) {
 		wlr_xwayland_shell_v1_destroy(xwayland->shell_v1);
@@ -112,14 +112,108 @@ struct wlr_xwayland_surface *wlr_xwayland_surface_try_from_wlr_surface(
 	return xsurface;
 }
 
-// TODO: replace this with hash table?
+static size_t surface_map_hash(xcb_window_t window_id, size_t cap) {
+	// Window IDs are allocated sequentially by each client, mix the bits
+	uint32_t h = window_id;
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	return h & (cap - 1);
+}
+
+static void surface_map_insert_slot(struct wlr_xwayland_surface **map,
+		size_t cap, struct wlr_xwayland_surface *surface) {
+	size_t i = surface_map_hash(surface->window_id, cap);
+	while (map[i] != NULL) {
+		i = (i + 1) & (cap - 1);
+	}
+	map[i] = surface;
+}
+
+static bool surface_map_grow(struct wlr_xwm *xwm) {
+	size_t cap = xwm->surface_map_cap == 0 ? 64 : xwm->surface_map_cap * 2;
+	struct wlr_xwayland_surface **map = calloc(cap, sizeof(*map));
+	if (map == NULL) {
+		return false;
+	}
+
+	for (size_t i = 0; i < xwm->surface_map_cap; i++) {
+		if (xwm->surface_map[i] != NULL) {
+			surface_map_insert_slot(map, cap, xwm->surface_map[i]);
+		}
+	}
+
+	free(xwm->surface_map);
+	xwm->surface_map = map;
+	xwm->surface_map_cap = cap;
+	return true;
+}
+
+static bool surface_map_insert(struct wlr_xwm *xwm,
+		struct wlr_xwayland_surface *surface) {
+	// Keep the load factor below 3/4, but keep going with a fuller map if
+	// growing fails as long as there is a free slot left
+	if ((xwm->surface_map_len + 1) * 4 > xwm->surface_map_cap * 3 &&
+			!surface_map_grow(xwm) &&
+			xwm->surface_map_len + 1 >= xwm->surface_map_cap) {
+		return false;
+	}
+
+	surface_map_insert_slot(xwm->surface_map, xwm->surface_map_cap, surface);
+	xwm->surface_map_len++;
+	return true;
+}
+
+static void surface_map_remove(struct wlr_xwm *xwm,
+		struct wlr_xwayland_surface *surface) {
+	size_t cap = xwm->surface_map_cap;
+	if (cap == 0) {
+		return;
+	}
+
+	size_t i = surface_map_hash(surface->window_id, cap);
+	while (xwm->surface_map[i] != surface) {
+		if (xwm->surface_map[i] == NULL) {
+			return;
+		}
+		i = (i + 1) & (cap - 1);
+	}
+
+	// Shift back the following entries of the probe sequence which would
+	// become unreachable
+	size_t j = i;
+	while (true) {
+		j = (j + 1) & (cap - 1);
+		struct wlr_xwayland_surface *next = xwm->surface_map[j];
+		if (next == NULL) {
+			break;
+		}
+		size_t k = surface_map_hash(next->window_id, cap);
+		bool reachable = i <= j ? (i < k && k <= j) : (i < k || k <= j);
+		if (!reachable) {
+			xwm->surface_map[i] = next;
+			i = j;
+		}
+	}
+
+	xwm->surface_map[i] = NULL;
+	xwm->surface_map_len--;
+}
+
 static struct wlr_xwayland_surface *lookup_surface(struct wlr_xwm *xwm,
 		xcb_window_t window_id) {
+	size_t cap = xwm->surface_map_cap;
+	if (cap == 0) {
+		return NULL;
+	}
+
+	size_t i = surface_map_hash(window_id, cap);
 	struct wlr_xwayland_surface *surface;
-	wl_list_for_each(surface, &xwm->surfaces, link) {
+	while ((surface = xwm->surface_map[i]) != NULL) {
 		if (surface->window_id == window_id) {
 			return surface;
 		}
+		i = (i + 1) & (cap - 1);
 	}
 	return NULL;
 }
@@ -204,6 +298,13 @@ static struct wlr_xwayland_surface *xwayland_surface_create(
 		return NULL;
 	}
 
+	if (!surface_map_insert(xwm, surface)) {
+		wl_event_source_remove(surface->ping_timer);
+		free(surface);
+		wlr_log(WLR_ERROR, "Could not allocate surface map");
+		return NULL;
+	}
+
 	wl_list_insert(&xwm->surfaces, &surface->link);
 
 	return surface;
@@ -216,6 +317,8 @@ static void xwm_set_net_active_window(struct wlr_xwm *xwm,
 			xwm->atoms[WINDOW], 32, 1, &window);
 }
 
+static void xwm_schedule_flush(struct wlr_xwm *xwm);
+
 static void xwm_send_wm_message(struct wlr_xwayland_surface *surface,
 		xcb_client_message_data_t *data, uint32_t event_mask) {
 	struct wlr_xwm *xwm = surface->xwm;
@@ -234,38 +337,27 @@ static void xwm_send_wm_message(struct wlr_xwayland_surface *surface,
 		surface->window_id,
 		event_mask,
 		(const char *)&event);
-	xcb_flush(xwm->xcb_conn);
+	xwm_schedule_flush(xwm);
 }
 
-static void xwm_set_net_client_list(struct wlr_xwm *xwm) {
-	// FIXME: _NET_CLIENT_LIST is expected to be ordered by map time, but the
-	// order of surfaces in `xwm->surfaces` is by creation time. The order of
-	// windows _NET_CLIENT_LIST exposed by wlroots is wrong.
-
-	size_t mapped_surfaces = 0;
-	struct wlr_xwayland_surface *surface;
-	wl_list_for_each(surface, &xwm->surfaces, link) {
-		if (surface->mapped) {
-			mapped_surfaces++;
-		}
-	}
+static void xwm_update_net_client_list(struct wlr_xwm *xwm) {
+	xcb_window_t *windows = xwm->client_list.data;
+	size_t len = xwm->client_list.size / sizeof(xcb_window_t);
 
-	xcb_window_t *windows = malloc(sizeof(xcb_window_t) * mapped_surfaces);
-	if (!windows) {
-		return;
-	}
-
-	size_t index = 0;
-	wl_list_for_each(surface, &xwm->surfaces, link) {
-		if (surface->mapped) {
-			windows[index++] = surface->window_id;
-		}
+	if (xwm->client_list_replace) {
+		xcb_change_property(xwm->xcb_conn, XCB_PROP_MODE_REPLACE,
+				xwm->screen->root, xwm->atoms[NET_CLIENT_LIST],
+				XCB_ATOM_WINDOW, 32, len, windows);
+	} else if (len > xwm->client_list_committed) {
+		// Only windows have been mapped since the last update
+		xcb_change_property(xwm->xcb_conn, XCB_PROP_MODE_APPEND,
+				xwm->screen->root, xwm->atoms[NET_CLIENT_LIST],
+				XCB_ATOM_WINDOW, 32, len - xwm->client_list_committed,
+				&windows[xwm->client_list_committed]);
 	}
 
-	xcb_change_property(xwm->xcb_conn, XCB_PROP_MODE_REPLACE,
-			xwm->screen->root, xwm->atoms[NET_CLIENT_LIST],
-			XCB_ATOM_WINDOW, 32, mapped_surfaces, windows);
-	free(windows);
+	xwm->client_list_committed = len;
+	xwm->client_list_replace = false;
 }
 
 static void xwm_set_net_client_list_stacking(struct wlr_xwm *xwm) {
@@ -287,6 +379,122 @@ static void xwm_set_net_client_list_stacking(struct wlr_xwm *xwm) {
 	free(windows);
 }
 
+static void xsurface_send_net_wm_state(struct wlr_xwayland_surface *xsurface);
+static void xsurface_send_configure(struct wlr_xwayland_surface *xsurface);
+
+/**
+ * Write the requests batched for a surface.
+ */
+static void xsurface_flush_pending(struct wlr_xwayland_surface *xsurface) {
+	if (xsurface->pending.configure) {
+		xsurface_send_configure(xsurface);
+		xsurface->pending.configure = false;
+	}
+	if (xsurface->pending.net_wm_state) {
+		xsurface_send_net_wm_state(xsurface);
+		xsurface->pending.net_wm_state = false;
+	}
+}
+
+static void xwm_handle_flush_idle(void *data) {
+	struct wlr_xwm *xwm = data;
+	xwm->flush_idle = NULL;
+
+	xcb_window_t *window;
+	wl_array_for_each(window, &xwm->dirty_surfaces) {
+		// The surface may have been destroyed since
+		struct wlr_xwayland_surface *xsurface = lookup_surface(xwm, *window);
+		if (xsurface != NULL) {
+			xsurface_flush_pending(xsurface);
+			xsurface->pending.queued = false;
+		}
+	}
+	xwm->dirty_surfaces.size = 0;
+
+	if (xwm->client_list_dirty) {
+		xwm_update_net_client_list(xwm);
+		xwm->client_list_dirty = false;
+	}
+	if (xwm->client_list_stacking_dirty) {
+		xwm_set_net_client_list_stacking(xwm);
+		xwm->client_list_stacking_dirty = false;
+	}
+	xcb_flush(xwm->xcb_conn);
+}
+
+/**
+ * Schedule a flush of the X11 connection. Batched requests are written and
+ * the connection is flushed once per event loop iteration.
+ */
+static void xwm_schedule_flush(struct wlr_xwm *xwm) {
+	if (xwm->flush_idle != NULL) {
+		return;
+	}
+
+	struct wl_event_loop *loop =
+		wl_display_get_event_loop(xwm->xwayland->wl_display);
+	xwm->flush_idle = wl_event_loop_add_idle(loop, xwm_handle_flush_idle, xwm);
+	if (xwm->flush_idle == NULL) {
+		wlr_log(WLR_ERROR, "Failed to add idle event source");
+		xwm_handle_flush_idle(xwm);
+	}
+}
+
+/**
+ * Queue the surface for the next flush, after setting its pending state.
+ */
+static void xsurface_mark_dirty(struct wlr_xwayland_surface *xsurface) {
+	struct wlr_xwm *xwm = xsurface->xwm;
+	if (!xsurface->pending.queued) {
+		xcb_window_t *window = wl_array_add(&xwm->dirty_surfaces,
+			sizeof(*window));
+		if (window == NULL) {
+			wlr_log(WLR_ERROR, "Allocation failed");
+			// Can't batch, write right away
+			xsurface_flush_pending(xsurface);
+			return;
+		}
+		*window = xsurface->window_id;
+		xsurface->pending.queued = true;
+	}
+	xwm_schedule_flush(xwm);
+}
+
+static void xwm_client_list_add(struct wlr_xwm *xwm, xcb_window_t window) {
+	xcb_window_t *ptr = wl_array_add(&xwm->client_list, sizeof(*ptr));
+	if (ptr == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return;
+	}
+	*ptr = window;
+
+	xwm->client_list_dirty = true;
+	xwm_schedule_flush(xwm);
+}
+
+static void xwm_client_list_remove(struct wlr_xwm *xwm, xcb_window_t window) {
+	xcb_window_t *windows = xwm->client_list.data;
+	size_t len = xwm->client_list.size / sizeof(xcb_window_t);
+	for (size_t i = 0; i < len; i++) {
+		if (windows[i] != window) {
+			continue;
+		}
+
+		// Keep the remaining windows in map order
+		memmove(&windows[i], &windows[i + 1],
+			(len - i - 1) * sizeof(xcb_window_t));
+		xwm->client_list.size -= sizeof(xcb_window_t);
+
+		if (i < xwm->client_list_committed) {
+			xwm->client_list_committed--;
+			xwm->client_list_replace = true;
+		}
+		xwm->client_list_dirty = true;
+		xwm_schedule_flush(xwm);
+		return;
+	}
+}
+
 static void xsurface_set_net_wm_state(struct wlr_xwayland_surface *xsurface);
 
 static void xwm_set_focus_window(struct wlr_xwm *xwm,
@@ -346,10 +554,10 @@ static void xwm_surface_activate(struct wlr_xwm *xwm,
 
 	xwm_set_focus_window(xwm, xsurface);
 
-	xcb_flush(xwm->xcb_conn);
+	xwm_schedule_flush(xwm);
 }
 
-static void xsurface_set_net_wm_state(struct wlr_xwayland_surface *xsurface) {
+static void xsurface_send_net_wm_state(struct wlr_xwayland_surface *xsurface) {
 	struct wlr_xwm *xwm = xsurface->xwm;
 
 	// EWMH says _NET_WM_STATE should be unset if the window is withdrawn
@@ -391,6 +599,12 @@ static void xsurface_set_net_wm_state(struct wlr_xwayland_surface *xsurface) {
 		i, property);
 }
 
+static void xsurface_set_net_wm_state(struct wlr_xwayland_surface *xsurface) {
+	// Only the last state of the batch is written
+	xsurface->pending.net_wm_state = true;
+	xsurface_mark_dirty(xsurface);
+}
+
 static void xwayland_surface_set_mapped(struct wlr_xwayland_surface *xsurface, bool mapped);
 
 static void xwayland_surface_dissociate(struct wlr_xwayland_surface *xsurface) {
@@ -421,7 +635,12 @@ static void xwayland_surface_destroy(struct wlr_xwayland_surface *xsurface) {
 		xwm_surface_activate(xsurface->xwm, NULL);
 	}
 
+	surface_map_remove(xsurface->xwm, xsurface);
 	wl_list_remove(&xsurface->link);
+	if (!wl_list_empty(&xsurface->stack_link)) {
+		xsurface->xwm->client_list_stacking_dirty = true;
+		xwm_schedule_flush(xsurface->xwm);
+	}
 	wl_list_remove(&xsurface->stack_link);
 	wl_list_remove(&xsurface->parent_link);
 
@@ -594,15 +813,19 @@ static void read_surface_parent(struct wlr_xwm *xwm,
 	wl_signal_emit_mutable(&xsurface->events.set_parent, xsurface);
 }
 
-static void read_surface_client_id(struct wlr_xwm *xwm,
-		struct wlr_xwayland_surface *xsurface) {
+static xcb_res_query_client_ids_cookie_t query_surface_client_id(
+		struct wlr_xwm *xwm, struct wlr_xwayland_surface *xsurface) {
 	xcb_res_client_id_spec_t spec = {
 		.client = xsurface->window_id,
 		.mask = XCB_RES_CLIENT_ID_MASK_LOCAL_CLIENT_PID
 	};
 
-	xcb_res_query_client_ids_cookie_t cookie = xcb_res_query_client_ids(
-		xwm->xcb_conn, 1, &spec);
+	return xcb_res_query_client_ids(xwm->xcb_conn, 1, &spec);
+}
+
+static void read_surface_client_id(struct wlr_xwm *xwm,
+		struct wlr_xwayland_surface *xsurface,
+		xcb_res_query_client_ids_cookie_t cookie) {
 	xcb_res_query_client_ids_reply_t *reply = xcb_res_query_client_ids_reply(
 		xwm->xcb_conn, cookie,  NULL);
 	if (reply == NULL) {
@@ -834,10 +1057,26 @@ char *xwm_get_atom_name(struct wlr_xwm *xwm, xcb_atom_t atom) {
 	return name;
 }
 
-static void read_surface_property(struct wlr_xwm *xwm,
+/**
+ * A GetProperty request whose reply hasn't been read yet. Requests are sent
+ * up-front and their replies are collected afterwards, so that reading several
+ * properties only costs a single round-trip to the X server.
+ */
+struct xwm_property_read {
+	xcb_window_t window;
+	xcb_atom_t property;
+	xcb_get_property_cookie_t cookie;
+};
+
+static xcb_get_property_cookie_t query_surface_property(struct wlr_xwm *xwm,
 		struct wlr_xwayland_surface *xsurface, xcb_atom_t property) {
-	xcb_get_property_cookie_t cookie = xcb_get_property(xwm->xcb_conn, 0,
-		xsurface->window_id, property, XCB_ATOM_ANY, 0, 2048);
+	return xcb_get_property(xwm->xcb_conn, 0, xsurface->window_id, property,
+		XCB_ATOM_ANY, 0, 2048);
+}
+
+static void read_surface_property(struct wlr_xwm *xwm,
+		struct wlr_xwayland_surface *xsurface, xcb_atom_t property,
+		xcb_get_property_cookie_t cookie) {
 	xcb_get_property_reply_t *reply = xcb_get_property_reply(xwm->xcb_conn,
 		cookie, NULL);
 	if (reply == NULL) {
@@ -871,7 +1110,8 @@ static void read_surface_property(struct wlr_xwm *xwm,
 		read_surface_role(xwm, xsurface, reply);
 	} else if (property == xwm->atoms[NET_STARTUP_ID]) {
 		read_surface_startup_id(xwm, xsurface, reply);
-	} else {
+	} else if (wlr_log_get_verbosity() >= WLR_DEBUG) {
+		// Resolving the atom name is a round-trip, only do it when logged
 		char *prop_name = xwm_get_atom_name(xwm, property);
 		wlr_log(WLR_DEBUG, "unhandled X11 property %" PRIu32 " (%s) for window %" PRIu32,
 			property, prop_name ? prop_name : "(null)", xsurface->window_id);
@@ -881,6 +1121,43 @@ static void read_surface_property(struct wlr_xwm *xwm,
 	free(reply);
 }
 
+static void xwm_queue_property_read(struct wlr_xwm *xwm,
+		struct wlr_xwayland_surface *xsurface, xcb_atom_t property) {
+	struct xwm_property_read *read =
+		wl_array_add(&xwm->pending_property_reads, sizeof(*read));
+	if (read == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return;
+	}
+	*read = (struct xwm_property_read){
+		.window = xsurface->window_id,
+		.property = property,
+		.cookie = query_surface_property(xwm, xsurface, property),
+	};
+}
+
+static void xwm_flush_property_reads(struct wlr_xwm *xwm) {
+	struct wl_array reads = xwm->pending_property_reads;
+	if (reads.size == 0) {
+		return;
+	}
+	wl_array_init(&xwm->pending_property_reads);
+
+	struct xwm_property_read *read;
+	wl_array_for_each(read, &reads) {
+		// The surface may have been destroyed by a previous reply's handler
+		struct wlr_xwayland_surface *xsurface =
+			lookup_surface(xwm, read->window);
+		if (xsurface == NULL) {
+			xcb_discard_reply(xwm->xcb_conn, read->cookie.sequence);
+			continue;
+		}
+		read_surface_property(xwm, xsurface, read->property, read->cookie);
+	}
+
+	wl_array_release(&reads);
+}
+
 static void xwayland_surface_set_mapped(struct wlr_xwayland_surface *xsurface, bool mapped) {
 	if (xsurface->mapped == mapped) {
 		return;
@@ -894,7 +1171,11 @@ static void xwayland_surface_set_mapped(struct wlr_xwayland_surface *xsurface, b
 		wl_signal_emit_mutable(&xsurface->events.unmap, xsurface);
 	}
 
-	xwm_set_net_client_list(xsurface->xwm);
+	if (mapped) {
+		xwm_client_list_add(xsurface->xwm, xsurface->window_id);
+	} else {
+		xwm_client_list_remove(xsurface->xwm, xsurface->window_id);
+	}
 }
 
 static void xwayland_surface_handle_commit(struct wl_listener *listener, void *data) {
@@ -954,11 +1235,21 @@ static void xwayland_surface_associate(struct wlr_xwm *xwm,
 		xwm->atoms[NET_WM_WINDOW_TYPE],
 		xwm->atoms[NET_WM_NAME],
 	};
+	// Send all requests before waiting for the first reply
+	xcb_get_property_cookie_t cookies[sizeof(props)/sizeof(xcb_atom_t)];
+	for (size_t i = 0; i < sizeof(props)/sizeof(xcb_atom_t); i++) {
+		cookies[i] = query_surface_property(xwm, xsurface, props[i]);
+	}
+	xcb_res_query_client_ids_cookie_t client_id_cookie = {0};
+	if (xwm->xres) {
+		client_id_cookie = query_surface_client_id(xwm, xsurface);
+	}
+
 	for (size_t i = 0; i < sizeof(props)/sizeof(xcb_atom_t); i++) {
-		read_surface_property(xwm, xsurface, props[i]);
+		read_surface_property(xwm, xsurface, props[i], cookies[i]);
 	}
 	if (xwm->xres) {
-		read_surface_client_id(xwm, xsurface);
+		read_surface_client_id(xwm, xsurface, client_id_cookie);
 	}
 
 	wl_signal_emit_mutable(&xwm->xwayland->events.new_surface, xsurface);
@@ -973,6 +1264,13 @@ static void xwm_handle_create_notify(struct wlr_xwm *xwm,
 		return;
 	}
 
+	struct wlr_xwayland_server *server = xwm->xwayland->server;
+	if (server != NULL && server->spare) {
+		// The first client window, the spare server is now in use
+		server->spare = false;
+		server->stats.spare_uses++;
+	}
+
 	xwayland_surface_create(xwm, ev->window, ev->x, ev->y,
 		ev->width, ev->height, ev->override_redirect);
 }
@@ -1101,8 +1399,8 @@ void wlr_xwayland_surface_restack(struct wlr_xwayland_surface *xsurface,
 	}
 
 	wl_list_insert(node, &xsurface->stack_link);
-	xwm_set_net_client_list_stacking(xwm);
-	xcb_flush(xwm->xcb_conn);
+	xwm->client_list_stacking_dirty = true;
+	xwm_schedule_flush(xwm);
 }
 
 static void xwm_handle_map_request(struct wlr_xwm *xwm,
@@ -1114,6 +1412,8 @@ static void xwm_handle_map_request(struct wlr_xwm *xwm,
 
 	wlr_xwayland_surface_set_withdrawn(xsurface, false);
 	wlr_xwayland_surface_restack(xsurface, NULL, XCB_STACK_MODE_BELOW);
+	// The window must be configured before it's mapped
+	xsurface_flush_pending(xsurface);
 	xcb_map_window(xwm->xcb_conn, ev->window);
 }
 
@@ -1151,7 +1451,8 @@ static void xwm_handle_property_notify(struct wlr_xwm *xwm,
 		return;
 	}
 
-	read_surface_property(xwm, xsurface, ev->atom);
+	// The reply is read once the current batch of events has been handled
+	xwm_queue_property_read(xwm, xsurface, ev->atom);
 }
 
 static void xwm_handle_surface_id_message(struct wlr_xwm *xwm,
@@ -1656,6 +1957,12 @@ static int x11_event_handler(int fd, uint32_t mask, void *data) {
 			break;
 		}
 
+		uint8_t type = event->response_type & XCB_EVENT_RESPONSE_TYPE_MASK;
+		if (type != XCB_PROPERTY_NOTIFY) {
+			// Other events may depend on the queued properties
+			xwm_flush_property_reads(xwm);
+		}
+
 		if (xwm_handle_selection_event(xwm, event)) {
 			free(event);
 			continue;
@@ -1705,6 +2012,8 @@ static int x11_event_handler(int fd, uint32_t mask, void *data) {
 		free(event);
 	}
 
+	xwm_flush_property_reads(xwm);
+
 	if (count) {
 		xcb_flush(xwm->xcb_conn);
 	}
@@ -1730,7 +2039,7 @@ static void handle_compositor_new_surface(struct wl_listener *listener,
 	wl_list_for_each(xsurface, &xwm->unpaired_surfaces, unpaired_link) {
 		if (xsurface->surface_id == surface_id) {
 			xwayland_surface_associate(xwm, xsurface, surface);
-			xcb_flush(xwm->xcb_conn);
+			xwm_schedule_flush(xwm);
 			return;
 		}
 	}
@@ -1770,17 +2079,13 @@ void wlr_xwayland_surface_activate(struct wlr_xwayland_surface *xsurface,
 	}
 }
 
-void wlr_xwayland_surface_configure(struct wlr_xwayland_surface *xsurface,
-		int16_t x, int16_t y, uint16_t width, uint16_t height) {
-	int old_w = xsurface->width;
-	int old_h = xsurface->height;
-
-	xsurface->x = x;
-	xsurface->y = y;
-	xsurface->width = width;
-	xsurface->height = height;
-
+static void xsurface_send_configure(struct wlr_xwayland_surface *xsurface) {
 	struct wlr_xwm *xwm = xsurface->xwm;
+	int16_t x = xsurface->pending.x;
+	int16_t y = xsurface->pending.y;
+	uint16_t width = xsurface->pending.width;
+	uint16_t height = xsurface->pending.height;
+
 	uint32_t mask = XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y |
 		XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT |
 		XCB_CONFIG_WINDOW_BORDER_WIDTH;
@@ -1792,7 +2097,9 @@ void wlr_xwayland_surface_configure(struct wlr_xwayland_surface *xsurface,
 	// we are supposed to send a synthetic event. See ICCCM part
 	// 4.1.5. But we ignore override-redirect windows as ICCCM does
 	// not apply to them.
-	if (width == old_w && height == old_h && !xsurface->override_redirect) {
+	if (width == xsurface->pending.configured_width &&
+			height == xsurface->pending.configured_height &&
+			!xsurface->override_redirect) {
 		xcb_configure_notify_event_t configure_notify = {
 			.response_type = XCB_CONFIGURE_NOTIFY,
 			.event = xsurface->window_id,
@@ -1807,8 +2114,27 @@ void wlr_xwayland_surface_configure(struct wlr_xwayland_surface *xsurface,
 			XCB_EVENT_MASK_STRUCTURE_NOTIFY,
 			(const char *)&configure_notify);
 	}
+}
 
-	xcb_flush(xwm->xcb_conn);
+void wlr_xwayland_surface_configure(struct wlr_xwayland_surface *xsurface,
+		int16_t x, int16_t y, uint16_t width, uint16_t height) {
+	// Consecutive configures are merged into a single ConfigureWindow
+	// request, sent with the size the window had before the first one
+	if (!xsurface->pending.configure) {
+		xsurface->pending.configured_width = xsurface->width;
+		xsurface->pending.configured_height = xsurface->height;
+	}
+	xsurface->pending.configure = true;
+	xsurface->pending.x = x;
+	xsurface->pending.y = y;
+	xsurface->pending.width = width;
+	xsurface->pending.height = height;
+	xsurface_mark_dirty(xsurface);
+
+	xsurface->x = x;
+	xsurface->y = y;
+	xsurface->width = width;
+	xsurface->height = height;
 }
 
 void wlr_xwayland_surface_close(struct wlr_xwayland_surface *xsurface) {
@@ -1829,7 +2155,7 @@ void wlr_xwayland_surface_close(struct wlr_xwayland_surface *xsurface) {
 		xwm_send_wm_message(xsurface, &message_data, XCB_EVENT_MASK_NO_EVENT);
 	} else {
 		xcb_kill_client(xwm->xcb_conn, xsurface->window_id);
-		xcb_flush(xwm->xcb_conn);
+		xwm_schedule_flush(xwm);
 	}
 }
 
@@ -1883,6 +2209,12 @@ void xwm_destroy(struct wlr_xwm *xwm) {
 	wl_list_for_each_safe(xsurface, tmp, &xwm->unpaired_surfaces, unpaired_link) {
 		xwayland_surface_destroy(xsurface);
 	}
+	if (xwm->flush_idle != NULL) {
+		wl_event_source_remove(xwm->flush_idle);
+	}
+	free(xwm->surface_map);
+	wl_array_release(&xwm->client_list);
+	wl_array_release(&xwm->dirty_surfaces);
 	wl_list_remove(&xwm->compositor_new_surface.link);
 	wl_list_remove(&xwm->compositor_destroy.link);
 	wl_list_remove(&xwm->shell_v1_new_surface.link);
@@ -1892,6 +2224,7 @@ void xwm_destroy(struct wlr_xwm *xwm) {
 	wl_list_for_each_safe(pending, next, &xwm->pending_startup_ids, link) {
 		pending_startup_id_destroy(pending);
 	}
+	wl_array_release(&xwm->pending_property_reads);
 
 	xwm->xwayland->xwm = NULL;
 	free(xwm);
@@ -2135,6 +2468,9 @@ struct wlr_xwm *xwm_create(struct wlr_xwayland *xwayland, int wm_fd) {
 	wl_list_init(&xwm->surfaces_in_stack_order);
 	wl_list_init(&xwm->unpaired_surfaces);
 	wl_list_init(&xwm->pending_startup_ids);
+	wl_array_init(&xwm->pending_property_reads);
+	wl_array_init(&xwm->client_list);
+	wl_array_init(&xwm->dirty_surfaces);
 	xwm->ping_timeout = 10000;
 
 	xwm->xcb_conn = xcb_connect_to_fd(wm_fd, NULL);
@@ -2216,6 +2552,7 @@ struct wlr_xwm *xwm_create(struct wlr_xwayland *xwayland, int wm_fd) {
 
 	xwm_set_net_active_window(xwm, XCB_WINDOW_NONE);
 
+	xwm->selection_chunk_size = xwm_selection_get_chunk_size(xwm);
 	xwm_selection_init(&xwm->clipboard_selection, xwm, xwm->atoms[CLIPBOARD]);
 	xwm_selection_init(&xwm->primary_selection, xwm, xwm->atoms[PRIMARY]);
 	xwm_selection_init(&xwm->dnd_selection, xwm, xwm->atoms[DND_SELECTION]);
@@ -2243,7 +2580,6 @@ void wlr_xwayland_surface_set_withdrawn(struct wlr_xwayland_surface *surface,
 	surface->withdrawn = withdrawn;
 	xsurface_set_wm_state(surface);
 	xsurface_set_net_wm_state(surface);
-	xcb_flush(surface->xwm->xcb_conn);
 }
 
 void wlr_xwayland_surface_set_minimized(struct wlr_xwayland_surface *surface,
@@ -2251,7 +2587,6 @@ void wlr_xwayland_surface_set_minimized(struct wlr_xwayland_surface *surface,
 	surface->minimized = minimized;
 	xsurface_set_wm_state(surface);
 	xsurface_set_net_wm_state(surface);
-	xcb_flush(surface->xwm->xcb_conn);
 }
 
 void wlr_xwayland_surface_set_maximized(struct wlr_xwayland_surface *surface,
@@ -2259,14 +2594,12 @@ void wlr_xwayland_surface_set_maximized(struct wlr_xwayland_surface *surface,
 	surface->maximized_horz = maximized;
 	surface->maximized_vert = maximized;
 	xsurface_set_net_wm_state(surface);
-	xcb_flush(surface->xwm->xcb_conn);
 }
 
 void wlr_xwayland_surface_set_fullscreen(struct wlr_xwayland_surface *surface,
 		bool fullscreen) {
 	surface->fullscreen = fullscreen;
 	xsurface_set_net_wm_state(surface);
-	xcb_flush(surface->xwm->xcb_conn);
 }
 
 bool xwm_atoms_contains(struct wlr_xwm *xwm, xcb_atom_t *atoms,